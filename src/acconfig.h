@@ -470,6 +470,9 @@
 /* Enable use of /dev/epoll on Linux. */
 #undef WITH_EPOLL
 
+/* Enable the io_uring backend on Linux. */
+#undef WITH_IO_URING
+
 /* Define to the poll device (eg "/dev/poll") */
 #undef PIKE_POLL_DEVICE
 
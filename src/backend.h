@@ -72,6 +72,17 @@
 #define BACKEND_USES_SELECT
 #endif /* HAVE_SYS_DEVPOLL_H && PIKE_POLL_DEVICE */
 
+#if defined(HAVE_LINUX_IO_URING_H) && defined(WITH_IO_URING)
+/*
+ * Backend using io_uring. This is never the default backend,
+ * but is available as Pike.IOUringBackend.
+ *
+ * Used on:
+ *   Linux 5.4 and above.
+ */
+#define BACKEND_HAS_IO_URING
+#endif /* HAVE_LINUX_IO_URING_H && WITH_IO_URING */
+
 struct Backend_struct;
 
 PMOD_EXPORT extern struct Backend_struct *default_backend;
@@ -28,6 +28,9 @@ static void ba_check_ptr(struct block_allocator * a, int page, void * ptr, struc
                          int ln);
 #endif
 
+/* Magazine statistics summed over all allocators. */
+static size_t ba_total_mag_hits = 0, ba_total_mag_misses = 0;
+
 static inline unsigned INT32 ba_block_number(const struct ba_layout * l, const struct ba_page * p,
                                              const void * ptr) {
     return ((char*)ptr - (char*)BA_BLOCKN(*l, p, 0)) / l->block_size;
@@ -161,6 +164,8 @@ PMOD_EXPORT void ba_init_aligned(struct block_allocator * a, unsigned INT32 bloc
     ba_low_init_aligned(a);
     a->alloc = a->last_free = a->size = 0;
     memset(a->pages, 0, sizeof(a->pages));
+    a->mag_used = 0;
+    a->mag_hits = a->mag_misses = 0;
 }
 
 PMOD_EXPORT void ba_destroy(struct block_allocator * a) {
@@ -179,6 +184,7 @@ PMOD_EXPORT void ba_destroy(struct block_allocator * a) {
 	}
     }
     a->alloc = a->last_free = a->size = 0;
+    a->mag_used = 0;
     PIKE_MEMPOOL_DESTROY(a);
 }
 
@@ -195,6 +201,7 @@ PMOD_EXPORT void ba_free_all(struct block_allocator * a) {
     a->size = 0;
     a->alloc = 0;
     a->last_free = 0;
+    a->mag_used = 0;
 }
 
 PMOD_EXPORT size_t ba_count(const struct block_allocator * a) {
@@ -204,7 +211,8 @@ PMOD_EXPORT size_t ba_count(const struct block_allocator * a) {
 	c += a->pages[i]->h.used;
     }
 
-    return c;
+    /* Blocks in the magazine are still marked as used in their pages. */
+    return c - a->mag_used;
 }
 
 PMOD_EXPORT void ba_count_all(const struct block_allocator * a, size_t * num, size_t * size) {
@@ -216,7 +224,7 @@ PMOD_EXPORT void ba_count_all(const struct block_allocator * a, size_t * num, si
         b += l.offset + l.block_size + l.doffset;
         n += a->pages[i]->h.used;
     }
-    *num = n;
+    *num = n - a->mag_used;
     *size = b;
 }
 
@@ -247,8 +255,7 @@ static void ba_low_alloc(struct block_allocator * a) {
     a->size++;
 }
 
-ATTRIBUTE((malloc))
-PMOD_EXPORT void * ba_alloc(struct block_allocator * a) {
+static void * ba_page_alloc(struct block_allocator * a) {
     struct ba_page * p = a->pages[a->alloc];
     struct ba_block_header * ptr;
 
@@ -292,18 +299,25 @@ PMOD_EXPORT void * ba_alloc(struct block_allocator * a) {
     return ptr;
 }
 
-PMOD_EXPORT void ba_free(struct block_allocator * a, void * ptr) {
+ATTRIBUTE((malloc))
+PMOD_EXPORT void * ba_alloc(struct block_allocator * a) {
+    if (a->mag_used) {
+        void * ptr = a->magazine[--a->mag_used];
+        a->mag_hits++;
+        ba_total_mag_hits++;
+        PIKE_MEMPOOL_ALLOC(a, ptr, a->l.block_size);
+        return ptr;
+    }
+    a->mag_misses++;
+    ba_total_mag_misses++;
+    return ba_page_alloc(a);
+}
+
+static void ba_page_free(struct block_allocator * a, void * ptr) {
     int i = a->last_free;
     struct ba_page * p = a->pages[i];
     struct ba_layout l = ba_get_layout(a, i);
 
-#if PIKE_DEBUG
-    if (a->l.alignment && (size_t)ptr & (a->l.alignment - 1)) {
-	print_allocator(a);
-	Pike_fatal("Returning unaligned pointer.\n");
-    }
-#endif
-
     if (BA_CHECK_PTR(l, p, ptr)) goto found;
 
 #ifdef PIKE_DEBUG
@@ -347,6 +361,79 @@ found:
     PIKE_MEMPOOL_FREE(a, ptr, a->l.block_size);
 }
 
+/*
+ * Returns the n oldest blocks in the magazine to their pages. They are
+ * removed from the magazine first, so that it stays consistent if
+ * ba_page_free throws.
+ */
+static void ba_drain_magazine(struct block_allocator * a, unsigned int n) {
+    void * blocks[BA_MAGAZINE_SIZE];
+    unsigned int i;
+
+    memcpy(blocks, a->magazine, n * sizeof(void *));
+    a->mag_used -= n;
+    memmove(a->magazine, a->magazine + n, a->mag_used * sizeof(void *));
+
+    for (i = 0; i < n; i++) {
+        PIKE_MEMPOOL_ALLOC(a, blocks[i], a->l.block_size);
+        ba_page_free(a, blocks[i]);
+    }
+}
+
+#ifdef PIKE_DEBUG
+static void ba_check_free(struct block_allocator * a, void * ptr) {
+    struct ba_layout l;
+    int i;
+
+    for (i = 0; i < a->mag_used; i++) {
+        if (a->magazine[i] == ptr)
+            Pike_fatal("Block %p freed twice.\n", ptr);
+    }
+
+    for (i = a->size-1, l = ba_get_layout(a, i); i >= 0; i--, ba_half_layout(&l)) {
+        if (BA_CHECK_PTR(l, a->pages[i], ptr)) {
+            ba_check_ptr(a, i, ptr, NULL, __LINE__);
+            return;
+        }
+    }
+
+    print_allocator(a);
+    Pike_fatal("Trying to free unknown block %p.\n", ptr);
+}
+#endif
+
+PMOD_EXPORT void ba_free(struct block_allocator * a, void * ptr) {
+#if PIKE_DEBUG
+    if (a->l.alignment && (size_t)ptr & (a->l.alignment - 1)) {
+	print_allocator(a);
+	Pike_fatal("Returning unaligned pointer.\n");
+    }
+    ba_check_free(a, ptr);
+#endif
+
+    if (a->mag_used == BA_MAGAZINE_SIZE)
+        ba_drain_magazine(a, BA_MAGAZINE_SIZE/2);
+
+    a->magazine[a->mag_used++] = ptr;
+    PIKE_MEMPOOL_FREE(a, ptr, a->l.block_size);
+}
+
+/* Returns all blocks in the magazine to their pages. */
+PMOD_EXPORT void ba_flush_magazine(struct block_allocator * a) {
+    if (a->mag_used)
+        ba_drain_magazine(a, a->mag_used);
+}
+
+/*
+ * Returns the number of allocations that were served from the
+ * magazines and the number that had to go to the pages, summed over
+ * all allocators.
+ */
+PMOD_EXPORT void ba_magazine_stats(size_t * hits, size_t * misses) {
+    *hits = ba_total_mag_hits;
+    *misses = ba_total_mag_misses;
+}
+
 #ifdef PIKE_DEBUG
 static void print_allocator(const struct block_allocator * a) {
     int i;
@@ -593,6 +680,9 @@ void ba_walk(struct block_allocator * a, ba_walk_callback cb, void * data) {
 
     it.l = ba_get_layout(a, 0);
 
+    /* Blocks in the magazine are free, so don't report them. */
+    ba_flush_magazine(a);
+
     if (!a->size) return;
 
     for (i = 0; i < a->size; i++) {
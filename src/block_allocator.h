@@ -31,9 +31,16 @@ struct ba_page {
     struct ba_page_header h;
 };
 
+/*
+ * Number of freed blocks kept in front of the pages of each allocator.
+ * Allocations are served from them first, which avoids the page lookup
+ * in ba_free and hands out recently used (cache warm) blocks.
+ */
+#define BA_MAGAZINE_SIZE 16
+
 struct block_allocator {
     struct ba_layout l;
-    unsigned char size, last_free, alloc;
+    unsigned char size, last_free, alloc, mag_used;
     /*
      * This places an upper limit on the number of blocks
      * and should be adjusted as needed.
@@ -44,6 +51,8 @@ struct block_allocator {
      * 192 GB of short pike strings with shift width 0 can be allocated.
      */
     struct ba_page * pages[24];
+    void * magazine[BA_MAGAZINE_SIZE];
+    size_t mag_hits, mag_misses;
 };
 
 struct ba_iterator {
@@ -69,10 +78,12 @@ static inline void PIKE_UNUSED_ATTRIBUTE * ba_it_val(struct ba_iterator * it) {
 
 #define BA_INIT_ALIGNED(block_size, blocks, alignment) {    \
     BA_LAYOUT_INIT(block_size, blocks, alignment),	    \
-    0, 0, 0,						    \
+    0, 0, 0, 0,						    \
     { NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,		    \
       NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,		    \
-      NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL }		    \
+      NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL },		    \
+    { NULL },						    \
+    0, 0						    \
 }
 
 #define BA_INIT(block_size, blocks) BA_INIT_ALIGNED(block_size, blocks, 0)
@@ -87,6 +98,8 @@ PMOD_EXPORT void ba_destroy(struct block_allocator * a);
 PMOD_EXPORT void ba_free_all(struct block_allocator * a);
 PMOD_EXPORT size_t ba_count(const struct block_allocator * a);
 PMOD_EXPORT void ba_count_all(const struct block_allocator * a, size_t * num, size_t * size);
+PMOD_EXPORT void ba_flush_magazine(struct block_allocator * a);
+PMOD_EXPORT void ba_magazine_stats(size_t * hits, size_t * misses);
 
 static inline void PIKE_UNUSED_ATTRIBUTE ba_init(struct block_allocator * a, unsigned INT32 block_size, unsigned INT32 blocks) {
     ba_init_aligned(a, block_size, blocks, 0);
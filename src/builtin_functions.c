@@ -7805,6 +7805,11 @@ struct callback *add_memory_usage_callback(callback_func call,
  *!   and the other named @expr{SYMBOL + "_bytes"@} containing
  *!   a best effort approximation of the size in bytes.
  *!
+ *!   @expr{"block_magazine_hits"@} and @expr{"block_magazine_misses"@}
+ *!   count the allocations from the block allocators that were served
+ *!   from recently freed blocks and that had to search the allocator
+ *!   pages, respectively.
+ *!
  *! @note
  *!   Exactly what fields this function returns is version dependant.
  *!
@@ -7926,6 +7931,15 @@ PMOD_EXPORT void f__memory_usage(INT32 args)
   COUNT(supporter_marker);
 #endif
 
+  {
+    size_t hits, misses;
+    ba_magazine_stats(&hits, &misses);
+    push_static_text("block_magazine_hits");
+    push_ulongest(hits);
+    push_static_text("block_magazine_misses");
+    push_ulongest(misses);
+  }
+
 #ifdef DEBUG_MALLOC
   {
     extern void count_memory_in_memory_maps(size_t*, size_t*);
@@ -10337,7 +10351,7 @@ void init_builtin_efuns(void)
 	   tFunc(tNone,tVoid), OPT_SIDE_EFFECT);
 
   ADD_EFUN("_gc_status",f__gc_status,
-	   tFunc(tNone,tMap(tString,tOr(tInt,tFloat))),
+	   tFunc(tNone,tMap(tString,tOr4(tInt,tFloat,tStr,tArr(tInt)))),
 	   OPT_EXTERNAL_DEPEND);
 
   ADD_FUNCTION ("implicit_gc_real_time", f_implicit_gc_real_time,
@@ -2291,6 +2291,10 @@ void ins_f_byte(unsigned int b)
   LABEL_C;
     }
     return;
+  case F_ADD:
+    /* The generic add is almost always used on ints in practice, so
+       it gets the same guarded fast path as F_ADD_INTS, falling back
+       to f_add when either argument isn't an int or on overflow. */
   case F_ADD_INTS:
     {
       ins_debug_instr_prologue(b, 0, 0);
@@ -2600,8 +2604,6 @@ void ins_f_byte(unsigned int b)
 
   case F_EQ:
   case F_NE:
-    /* Note: We can do better when doing equality comparison
-       without much work. */
   case F_LE:
   case F_GE:
   case F_LT:
@@ -2609,7 +2611,53 @@ void ins_f_byte(unsigned int b)
     {
       LABELS();
       ins_debug_instr_prologue(b, 0, 0);
-      if_not_two_int(&label_A,1);
+      if( b+F_OFFSET == F_EQ || b+F_OFFSET == F_NE )
+      {
+        /* Two strings. Since strings are shared they are equal
+           exactly when they are the same string.
+
+           This comes before the integer case to keep all the
+           branches short. Anything unexpected, including a string
+           that would be freed by the pop, continues at label_A. */
+        amd64_load_sp_reg();
+        mov_mem8_reg(sp_reg, SVAL(-1).type, P_REG_RAX );
+        cmp_reg32_imm(P_REG_RAX, PIKE_T_STRING);
+        jne(&label_A);
+        mov_mem8_reg(sp_reg, SVAL(-2).type, P_REG_RAX );
+        cmp_reg32_imm(P_REG_RAX, PIKE_T_STRING);
+        jne(&label_A);
+
+        mov_mem_reg(sp_reg, SVAL(-1).value, P_REG_RAX );
+        mov_mem_reg(sp_reg, SVAL(-2).value, P_REG_RCX );
+        mov_mem32_reg(P_REG_RAX, OFFSETOF(pike_string,refs), P_REG_RDX );
+        cmp_reg32_imm(P_REG_RDX, 1);
+        jle(&label_A);
+        mov_mem32_reg(P_REG_RCX, OFFSETOF(pike_string,refs), P_REG_RDX );
+        cmp_reg32_imm(P_REG_RDX, 1);
+        jle(&label_A);
+        /* Both svalues may hold the same string, which then loses two
+           references. */
+        cmp_reg_reg(P_REG_RAX, P_REG_RCX);
+        jne(&label_C);
+        cmp_reg32_imm(P_REG_RDX, 2);
+        jle(&label_A);
+      LABEL_C;
+        add_mem32_imm(P_REG_RAX, OFFSETOF(pike_string,refs), -1);
+        add_mem32_imm(P_REG_RCX, OFFSETOF(pike_string,refs), -1);
+
+        clear_reg(P_REG_RDX);
+        cmp_reg_reg(P_REG_RAX, P_REG_RCX);
+        if( b+F_OFFSET == F_EQ )
+          set_if_eq(P_REG_RDX);
+        else
+          set_if_neq(P_REG_RDX);
+        amd64_add_sp(-1);
+        mov_imm_mem(PIKE_T_INT, sp_reg, SVAL(-1).type );
+        mov_reg_mem(P_REG_RDX, sp_reg, SVAL(-1).value );
+        jmp(&label_D);
+      }
+      LABEL_A;
+      if_not_two_int(&label_B,1);
       amd64_add_sp(-1);
 
       clear_reg(P_REG_RCX);
@@ -2629,22 +2677,13 @@ void ins_f_byte(unsigned int b)
       mov_reg_mem(P_REG_RCX, sp_reg, SVAL(-1).value );
       jmp(&label_D);
 
-      LABEL_A;
+      LABEL_B;
       /* not an integer. Use C version for simplicitly.. */
       amd64_call_c_opcode( addr, flags );
       amd64_load_sp_reg();
       LABEL_D;
     }
     return;
-  case F_ADD:
-    {
-    addr = f_add;
-    update_arg1(2);
-    amd64_call_c_opcode(addr, flags);
-    amd64_load_sp_reg();
-    }
-    return;
-
   case F_SUBTRACT:
     {
     LABELS();
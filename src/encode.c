@@ -32,6 +32,7 @@
 #include "bitvector.h"
 #include "pike_float.h"
 #include "sprintf.h"
+#include "encode.h"
 
 /* #define ENCODE_DEBUG */
 
@@ -161,6 +162,8 @@ struct encode_data
    * value less than COUNTER_START means that it's a forward reference
    * to a thing not yet encoded. */
   struct array *delayed;
+  /* The dictionary of the value stream, or NULL. */
+  struct mapping *dict;
   struct byte_buffer buf;
 #ifdef ENCODE_DEBUG
   int debug, depth;
@@ -480,6 +483,14 @@ static void encode_value2(struct svalue *val, struct encode_data *data, int forc
      !val->u.object->prog)
     val = &dested;
 
+  if(data->dict && (tmp=low_mapping_lookup(data->dict, val)))
+  {
+    EDB(1,fprintf(stderr, "%*sEncoding TAG_AGAIN from stream <%d>\n",
+		  data->depth, "", tmp->u.integer));
+    code_entry(TAG_AGAIN, tmp->u.integer, data);
+    goto encode_done;
+  }
+
   if((tmp=low_mapping_lookup(data->encoded, val)))
   {
     entry_id = *tmp;		/* It's always a small integer. */
@@ -521,7 +532,9 @@ static void encode_value2(struct svalue *val, struct encode_data *data, int forc
 	    print_svalue(stderr, val);
 	  }
 	  fputc('\n', stderr););
-      if( TYPEOF(*val) < MIN_REF_TYPE || val->u.dummy->refs > 1 )
+      /* Strings in value streams may be referenced by later messages. */
+      if( TYPEOF(*val) < MIN_REF_TYPE || val->u.dummy->refs > 1 ||
+          (data->dict && TYPEOF(*val) == T_STRING) )
           mapping_insert(data->encoded, val, &entry_id);
       data->counter.u.integer++;
     }
@@ -1763,6 +1776,7 @@ void f_encode_value(INT32 args)
   data->encoded=allocate_mapping(128);
   data->encoded->data->flags |= MAPPING_FLAG_NO_SHRINK;
   data->delayed = allocate_array (0);
+  data->dict = NULL;
   SET_SVAL(data->counter, T_INT, NUMBER_NUMBER, integer, COUNTER_START);
 
 #ifdef ENCODE_DEBUG
@@ -1840,6 +1854,7 @@ void f_encode_value_canonic(INT32 args)
   data->canonic = 1;
   data->encoded=allocate_mapping(128);
   data->delayed = allocate_array (0);
+  data->dict = NULL;
   SET_SVAL(data->counter, T_INT, NUMBER_NUMBER, integer, COUNTER_START);
 
 #ifdef ENCODE_DEBUG
@@ -1906,6 +1921,8 @@ struct decode_data
   int pickyness;
   int pass;
   int delay_counter;
+  /* The dictionary of the value stream, or NULL. */
+  struct mapping *dict;
   struct pike_string *raw;
   struct decode_data *next;
 #ifdef PIKE_THREADS
@@ -2460,7 +2477,8 @@ static void decode_value2(struct decode_data *data)
       EDB (1, fprintf(stderr, "%*sDecoding TAG_AGAIN from <%d>\n",
 		      data->depth, "", num););
       SET_SVAL(entry_id, T_INT, NUMBER_NUMBER, integer, num);
-      if((tmp2=low_mapping_lookup(data->decoded, &entry_id)))
+      if((tmp2=low_mapping_lookup(data->decoded, &entry_id)) ||
+	 (data->dict && (tmp2=low_mapping_lookup(data->dict, &entry_id))))
       {
 	push_svalue(tmp2);
       }else{
@@ -4013,6 +4031,7 @@ static INT32 my_decode(struct pike_string *tmp,
   data->unfinished_objects=0;
   data->unfinished_placeholders = NULL;
   data->delay_counter = 0;
+  data->dict = NULL;
   data->raw = tmp;
   data->next = current_decode;
 #ifdef PIKE_THREADS
@@ -4057,6 +4076,159 @@ static INT32 my_decode(struct pike_string *tmp,
   return 1;
 }
 
+/* Value streams.
+ *
+ * The messages of a value stream share the entry IDs of strings and
+ * types, so that a string that has been sent once is sent as a
+ * TAG_AGAIN reference in later messages. Both ends add the same
+ * entries to their dictionaries after each message, and empty them
+ * at the same time when they grow too large or the entry IDs get too
+ * big, so they stay in sync without any extra data in the stream.
+ */
+
+#define STREAM_MAX_STRING_LEN	256
+#define STREAM_MAX_ENTRIES	16384
+#define STREAM_MAX_COUNTER	(1<<24)
+
+PMOD_EXPORT void init_value_stream(struct value_stream *vs)
+{
+  vs->dict = allocate_mapping(128);
+  vs->counter = COUNTER_START;
+}
+
+PMOD_EXPORT void free_value_stream(struct value_stream *vs)
+{
+  if (vs->dict) free_mapping(vs->dict);
+  vs->dict = NULL;
+}
+
+/* Adds the short strings and types among the entries of a message to
+ * the dictionary. entries maps values to entry IDs when encoding, and
+ * entry IDs to values when decoding. */
+static void update_value_stream(struct value_stream *vs,
+				struct mapping *entries, int by_id,
+				INT_TYPE counter)
+{
+  struct mapping_data *md = entries->data;
+  struct keypair *k;
+  INT32 e;
+
+  NEW_MAPPING_LOOP(md) {
+    struct svalue *val = by_id ? &k->val : &k->ind;
+    if ((TYPEOF(*val) == T_STRING &&
+	 val->u.string->len <= STREAM_MAX_STRING_LEN) ||
+	TYPEOF(*val) == T_TYPE)
+      mapping_insert(vs->dict, &k->ind, &k->val);
+  }
+
+  /* The counter grows with every encoded value, also when few of
+   * them end up in the dictionary, so it needs its own limit to keep
+   * the entry IDs small. */
+  if (m_sizeof(vs->dict) > STREAM_MAX_ENTRIES ||
+      counter > STREAM_MAX_COUNTER) {
+    clear_mapping(vs->dict);
+    counter = COUNTER_START;
+  }
+  vs->counter = counter;
+}
+
+/* Encodes one message of a value stream. The result has no header. */
+PMOD_EXPORT struct pike_string *encode_value_message(struct value_stream *vs,
+						     struct svalue *val,
+						     struct object *codec)
+{
+  ONERROR tmp;
+  struct encode_data d, *data;
+  int i;
+  data=&d;
+
+  buffer_init(&data->buf);
+  data->canonic = 0;
+  data->encoded=allocate_mapping(32);
+  data->encoded->data->flags |= MAPPING_FLAG_NO_SHRINK;
+  data->delayed = allocate_array (0);
+  data->dict = vs->dict;
+  SET_SVAL(data->counter, T_INT, NUMBER_NUMBER, integer, vs->counter);
+#ifdef ENCODE_DEBUG
+  data->debug = 0;
+  data->depth = -2;
+#endif
+  data->codec = codec;
+  if (codec) add_ref (codec);
+
+  SET_ONERROR(tmp, free_encode_data, data);
+
+  encode_value2(val, data, 1);
+
+  for (i = 0; i < data->delayed->size; i++)
+    encode_value2 (ITEM(data->delayed) + i, data, 2);
+
+  UNSET_ONERROR(tmp);
+
+  update_value_stream(vs, data->encoded, 0, data->counter.u.integer);
+
+  if (data->codec) free_object (data->codec);
+  free_mapping(data->encoded);
+  free_array (data->delayed);
+
+  return buffer_finish_pike_string(&data->buf);
+}
+
+/* Decodes one message of a value stream, and pushes the value. */
+PMOD_EXPORT void decode_value_message(struct value_stream *vs,
+				      struct pike_string *msg,
+				      struct object *codec)
+{
+  struct decode_data *data;
+  ONERROR err;
+
+  if (msg->size_shift)
+    Pike_error("Value stream messages must be 8-bit strings.\n");
+
+  data=ALLOC_STRUCT(decode_data);
+  SET_SVAL(data->counter, T_INT, NUMBER_NUMBER, integer, vs->counter);
+  data->data_str = msg;
+  data->data=(unsigned char *)msg->str;
+  data->len=msg->len;
+  data->ptr=0;
+  data->codec=codec;
+  data->explicit_codec = codec ? 1 : 0;
+  data->pickyness=0;
+  data->pass=1;
+  data->unfinished_programs=0;
+  data->unfinished_objects=0;
+  data->unfinished_placeholders = NULL;
+  data->delay_counter = 0;
+  data->dict = vs->dict;
+  data->raw = msg;
+  data->next = current_decode;
+#ifdef PIKE_THREADS
+  data->thread_state = Pike_interpreter.thread_state;
+  data->thread_obj = Pike_interpreter.thread_state->thread_obj;
+#endif
+#ifdef ENCODE_DEBUG
+  data->debug = 0;
+  data->depth = -2;
+#endif
+
+  data->decoded=allocate_mapping(32);
+
+  add_ref (data->data_str);
+  if (data->codec) add_ref (data->codec);
+#ifdef PIKE_THREADS
+  add_ref (data->thread_obj);
+#endif
+  SET_ONERROR(err, error_free_decode_data, data);
+
+  low_do_decode (data);
+
+  UNSET_ONERROR(err);
+
+  update_value_stream(vs, data->decoded, 1, data->counter.u.integer);
+
+  free_decode_data (data, 0, 0);
+}
+
 /*! @class MasterObject
  */
 
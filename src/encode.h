@@ -7,12 +7,27 @@
 #ifndef ENCODE_H
 #define ENCODE_H
 
+/* The state shared by the messages of a value stream. */
+struct value_stream
+{
+  struct mapping *dict;
+  INT_TYPE counter;
+};
+
 /* Prototypes begin here */
 struct encode_data;
 void f_encode_value(INT32 args);
 void f_encode_value_canonic(INT32 args);
 struct decode_data;
 void f_decode_value(INT32 args);
+PMOD_EXPORT void init_value_stream(struct value_stream *vs);
+PMOD_EXPORT void free_value_stream(struct value_stream *vs);
+PMOD_EXPORT struct pike_string *encode_value_message(struct value_stream *vs,
+						     struct svalue *val,
+						     struct object *codec);
+PMOD_EXPORT void decode_value_message(struct value_stream *vs,
+				      struct pike_string *msg,
+				      struct object *codec);
 /* Prototypes end here */
 
 #endif
@@ -553,6 +553,52 @@ static enum {
   GARBAGE_RATIO_LOW, GARBAGE_RATIO_HIGH, GARBAGE_MAX_INTERVAL
 } last_garbage_strategy = GARBAGE_RATIO_LOW;
 
+/* Real time spent in the different passes of the last gc run, and a
+ * histogram over the total real time of all gc runs so far. Bucket n
+ * counts the runs that took at least 2^(n-1) but less than 2^n
+ * microseconds, and the last bucket also counts everything longer.
+ * These are only collected for the sake of gc_status too. */
+enum gc_timed_pass {
+  GC_TIME_CHECK, GC_TIME_MARK, GC_TIME_CYCLE, GC_TIME_ZAP_WEAK,
+  GC_TIME_FREE, GC_TIME_KILL, GC_TIME_DESTRUCT,
+  GC_NUM_TIMED_PASSES, GC_TIME_NONE = -1
+};
+static const char *const gc_timed_pass_names[GC_NUM_TIMED_PASSES] = {
+  "last_check_time", "last_mark_time", "last_cycle_time",
+  "last_zap_weak_time", "last_free_time", "last_kill_time",
+  "last_destruct_time",
+};
+static cpu_time_t gc_pass_times[GC_NUM_TIMED_PASSES];
+static cpu_time_t gc_pass_start;
+static int gc_cur_timed_pass = GC_TIME_NONE;
+
+#define GC_PAUSE_BUCKETS 24
+static INT64 gc_pause_histogram[GC_PAUSE_BUCKETS];
+static cpu_time_t gc_max_pause = 0;
+
+/* Charge the real time since the last call to the pass that was
+ * current then, and start timing the given one. */
+static void gc_time_pass (int pass)
+{
+  cpu_time_t now = get_real_time();
+  if (gc_cur_timed_pass != GC_TIME_NONE && now > gc_pass_start)
+    gc_pass_times[gc_cur_timed_pass] += now - gc_pass_start;
+  gc_cur_timed_pass = pass;
+  gc_pass_start = now;
+}
+
+static void gc_record_pause (cpu_time_t pause)
+{
+  double usec = (double) pause * 1000000.0 / CPU_TIME_TICKS;
+  int bucket = 0;
+  while (usec >= 1.0 && bucket < GC_PAUSE_BUCKETS - 1) {
+    usec /= 2.0;
+    bucket++;
+  }
+  gc_pause_histogram[bucket]++;
+  if (pause > gc_max_pause) gc_max_pause = pause;
+}
+
 struct callback_list gc_callbacks;
 
 /* These callbacks are run early in the check pass of the gc and when
@@ -3515,6 +3561,8 @@ size_t do_gc(void *UNUSED(ignored), int explicit_call)
 
   /* First we count internal references */
   Pike_in_gc=GC_PASS_CHECK;
+  memset (gc_pass_times, 0, sizeof (gc_pass_times));
+  gc_time_pass (GC_TIME_CHECK);
   gc_ext_weak_refs = 0;
 
 #ifdef PIKE_DEBUG
@@ -3541,6 +3589,7 @@ size_t do_gc(void *UNUSED(ignored), int explicit_call)
    * by gc_free_(short_)svalue. */
 
   Pike_in_gc=GC_PASS_MARK;
+  gc_time_pass (GC_TIME_MARK);
 
   /* Anything after and including gc_internal_* in the linked lists
    * are considered to lack external references. The mark pass move
@@ -3590,6 +3639,7 @@ size_t do_gc(void *UNUSED(ignored), int explicit_call)
     obj_count = delayed_freed;
 #endif
     Pike_in_gc=GC_PASS_CYCLE;
+    gc_time_pass (GC_TIME_CYCLE);
 
     /* Now find all cycles in the internal structures. Note that we can
      * follow the same reference several times, just like in the mark
@@ -3634,6 +3684,7 @@ size_t do_gc(void *UNUSED(ignored), int explicit_call)
     obj_count = delayed_freed;
 #endif
     Pike_in_gc = GC_PASS_ZAP_WEAK;
+    gc_time_pass (GC_TIME_ZAP_WEAK);
     CHECK_MARK_QUEUE_EMPTY();
     /* Zap weak references from external to internal things. That
      * occurs when something has both external weak refs and nonweak
@@ -3695,6 +3746,7 @@ size_t do_gc(void *UNUSED(ignored), int explicit_call)
   /* Object alloc/free and reference changes are allowed again now. */
 
   Pike_in_gc=GC_PASS_FREE;
+  gc_time_pass (GC_TIME_FREE);
 #ifdef PIKE_DEBUG
   weak_freed = 0;
   obj_count = num_objects;
@@ -3753,6 +3805,7 @@ size_t do_gc(void *UNUSED(ignored), int explicit_call)
 #endif
 
   Pike_in_gc=GC_PASS_KILL;
+  gc_time_pass (GC_TIME_KILL);
 
   /* Destruct the live objects in cycles, but first warn about any bad
    * cycles. */
@@ -3856,9 +3909,11 @@ size_t do_gc(void *UNUSED(ignored), int explicit_call)
 			destruct_count, pre_kill_objs - num_objects));
 
   Pike_in_gc=GC_PASS_DESTRUCT;
+  gc_time_pass (GC_TIME_DESTRUCT);
   /* Destruct objects on the destruct queue. */
   GC_VERBOSE_DO(obj_count = num_objects);
   destruct_objects_to_destruct();
+  gc_time_pass (GC_TIME_NONE);
   GC_VERBOSE_DO(fprintf(stderr, "| destruct: %d things really freed\n",
 			obj_count - num_objects));
 
@@ -3915,6 +3970,7 @@ size_t do_gc(void *UNUSED(ignored), int explicit_call)
     if (last_gc_end_real_time > gc_start_real_time) {
       gc_time = gc_time * multiplier +
 	(last_gc_end_real_time - gc_start_real_time) * (1.0 - multiplier);
+      gc_record_pause (last_gc_end_real_time - gc_start_real_time);
     }
 
 #ifdef GC_INTERVAL_DEBUG
@@ -4104,7 +4160,7 @@ size_t do_gc(void *UNUSED(ignored), int explicit_call)
   return unreferenced;
 }
 
-/*! @decl mapping(string:int|float) gc_status()
+/*! @decl mapping(string:int|float|string|array(int)) gc_status()
  *! @belongs Debug
  *!
  *! Get statistics from the garbage collector.
@@ -4152,6 +4208,25 @@ size_t do_gc(void *UNUSED(ignored), int explicit_call)
  *!     @member int "total_gc_real_time"
  *!       The total amount of real time that has been spent in
  *!       implicit GC runs, in nanoseconds.
+ *!     @member int "last_check_time"
+ *!     @member int "last_mark_time"
+ *!     @member int "last_cycle_time"
+ *!     @member int "last_zap_weak_time"
+ *!     @member int "last_free_time"
+ *!     @member int "last_kill_time"
+ *!     @member int "last_destruct_time"
+ *!       The real time in nanoseconds that the last gc run spent in
+ *!       the respective pass. They add up to roughly the whole length
+ *!       of the run, and tell which kind of work dominates it.
+ *!     @member int "max_gc_pause"
+ *!       The longest gc run so far, in real time nanoseconds. The
+ *!       interpreter is stopped during the whole run, so this is the
+ *!       worst pause the gc has caused.
+ *!     @member array(int) "gc_pause_histogram"
+ *!       The number of gc runs per length in real time. Element
+ *!       @expr{n@} counts the runs that took less than @expr{2^n@}
+ *!       but at least @expr{2^(n-1)@} microseconds. The last element
+ *!       also counts all longer runs.
  *!   @endmapping
  *!
  *! @seealso
@@ -4235,6 +4310,33 @@ void f__gc_status(INT32 args)
 #endif
   size++;
 
+  {
+    int i;
+    for (i = 0; i < GC_NUM_TIMED_PASSES; i++) {
+      push_text (gc_timed_pass_names[i]);
+      push_int64 (gc_pass_times[i]);
+#ifndef LONG_CPU_TIME
+      push_int (1000000000 / CPU_TIME_TICKS);
+      o_multiply();
+#endif
+      size++;
+    }
+
+    push_static_text ("max_gc_pause");
+    push_int64 (gc_max_pause);
+#ifndef LONG_CPU_TIME
+    push_int (1000000000 / CPU_TIME_TICKS);
+    o_multiply();
+#endif
+    size++;
+
+    push_static_text ("gc_pause_histogram");
+    for (i = 0; i < GC_PAUSE_BUCKETS; i++)
+      push_int64 (gc_pause_histogram[i]);
+    f_aggregate (GC_PAUSE_BUCKETS);
+    size++;
+  }
+
 #ifdef PIKE_DEBUG
   push_static_text ("max_rec_frames");
   push_int64 ((INT64) tot_max_rec_frames);
@@ -2063,20 +2063,30 @@ OPCODE2(F_GLOBAL_LOCAL_INDEX, "global[local]", I_UPDATE_SP, {
 
 OPCODE2(F_LOCAL_ARROW, "local->x", I_UPDATE_SP, {
   struct pike_frame *fp = Pike_fp;
+  struct svalue *s = fp->locals + arg2;
   struct svalue tmp;
-  SET_SVAL(tmp, PIKE_T_STRING, 1, string,
-	   fp->context->prog->strings[arg1]);
   mark_free_svalue (Pike_sp++);
-  index_no_free(Pike_sp-1,fp->locals+arg2, &tmp);
+  if ((TYPEOF(*s) != T_OBJECT) ||
+      !object_arrow_cached_no_free(Pike_sp-1, s->u.object, SUBTYPEOF(*s),
+				   fp->context->prog, arg1)) {
+    SET_SVAL(tmp, PIKE_T_STRING, 1, string,
+	     fp->context->prog->strings[arg1]);
+    index_no_free(Pike_sp-1, s, &tmp);
+  }
   print_return_value();
 });
 
 OPCODE1(F_ARROW, "->x", 0, {
   struct svalue tmp;
   struct svalue tmp2;
-  SET_SVAL(tmp, PIKE_T_STRING, 1, string,
-	   Pike_fp->context->prog->strings[arg1]);
-  index_no_free(&tmp2, Pike_sp-1, &tmp);
+  if ((TYPEOF(Pike_sp[-1]) != T_OBJECT) ||
+      !object_arrow_cached_no_free(&tmp2, Pike_sp[-1].u.object,
+				   SUBTYPEOF(Pike_sp[-1]),
+				   Pike_fp->context->prog, arg1)) {
+    SET_SVAL(tmp, PIKE_T_STRING, 1, string,
+	     Pike_fp->context->prog->strings[arg1]);
+    index_no_free(&tmp2, Pike_sp-1, &tmp);
+  }
   free_svalue(Pike_sp-1);
   move_svalue (Pike_sp - 1, &tmp2);
   print_return_value();
@@ -2434,8 +2444,7 @@ OPCODE1_JUMP(F_CALL_OTHER,"call other", I_UPDATE_ALL, {
       {
         PIKE_OPCODE_T *addr;
 	int fun;
-	fun=find_shared_string_identifier(Pike_fp->context->prog->strings[arg1],
-					  p);
+	fun=find_cached_identifier(Pike_fp->context->prog, arg1, p);
 	if(fun >= 0)
 	{
 	  fun += o->prog->inherits[SUBTYPEOF(*s)].identifier_level;
@@ -2492,8 +2501,7 @@ OPCODE1_JUMP(F_CALL_OTHER_AND_POP,"call other & pop", I_UPDATE_ALL, {
       {
 	int fun;
         PIKE_OPCODE_T *addr;
-	fun=find_shared_string_identifier(Pike_fp->context->prog->strings[arg1],
-					  p);
+	fun=find_cached_identifier(Pike_fp->context->prog, arg1, p);
 	if(fun >= 0)
 	{
 	  fun += o->prog->inherits[SUBTYPEOF(*s)].identifier_level;
@@ -2553,8 +2561,7 @@ OPCODE1_RETURN(F_CALL_OTHER_AND_RETURN,"call other & return", I_UPDATE_ALL, {
       {
 	int fun;
         PIKE_OPCODE_T *addr;
-	fun=find_shared_string_identifier(Pike_fp->context->prog->strings[arg1],
-					  p);
+	fun=find_cached_identifier(Pike_fp->context->prog, arg1, p);
 	if(fun >= 0)
 	{
 	  fun += o->prog->inherits[SUBTYPEOF(*s)].identifier_level;
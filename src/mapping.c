@@ -23,15 +23,32 @@
 #include "opcodes.h"
 #include "pike_cpulib.h"
 
-/* Average number of keypairs per slot when allocating. */
-#define AVG_LINK_LENGTH 4
+/* Average number of keypairs per slot when allocating. Every link
+ * followed in a lookup is typically a cache miss, so keep it short.
+ * Compared to 4, this makes lookups in mappings larger than the cache
+ * about a third faster, for 2 bytes more per keypair.
+ */
+#define AVG_LINK_LENGTH 2
+
+/* Hash size to use when a small mapping grows. */
+#define MIN_HASHSIZE 8
+
+/* Mappings with at most this many elements are kept with a hash
+ * size of 1, ie as a flat block of keypairs that is scanned linearly.
+ */
+#define SMALL_MAPPING_SIZE 8
+
+/* Number of keypairs to allocate for a given hash size. */
+#define HASH_KEYPAIRS(HSIZE) \
+  ((HSIZE) == 1 ? SMALL_MAPPING_SIZE : (HSIZE) * AVG_LINK_LENGTH)
 
 /* Minimum number of elements in a hashtable is half of the slots. */
 #define MIN_LINK_LENGTH_NUMERATOR	1
 #define MIN_LINK_LENGTH_DENOMINATOR	2
 
 /* Number of keypairs to allocate for a given size. */
-#define MAP_SLOTS(X) ((X)?((X)+((X)>>4)+8):0)
+#define MAP_SLOTS(X) \
+  ((X)?((X) <= SMALL_MAPPING_SIZE ? (X) : (X)+((X)>>4)+8):0)
 
 struct mapping *first_mapping;
 
@@ -213,7 +230,7 @@ static void init_mapping(struct mapping *m,
       hashsize = find_next_power(hashsize);
     }
 
-    size = hashsize * AVG_LINK_LENGTH;
+    size = HASH_KEYPAIRS(hashsize);
 
     e=MAPPING_DATA_SIZE(hashsize, size);
 
@@ -279,7 +296,10 @@ static struct mapping *allocate_mapping_no_init(void)
 PMOD_EXPORT struct mapping *debug_allocate_mapping(int size)
 {
   struct mapping *m = allocate_mapping_no_init();
-  init_mapping(m, (size + AVG_LINK_LENGTH - 1) / AVG_LINK_LENGTH, 0);
+  if (size <= SMALL_MAPPING_SIZE)
+    init_mapping(m, size ? 1 : 0, 0);
+  else
+    init_mapping(m, (size + AVG_LINK_LENGTH - 1) / AVG_LINK_LENGTH, 0);
   return m;
 }
 
@@ -523,6 +543,16 @@ static void mapping_rehash_backwards_good(struct mapping_data *md,
   }
 }
 
+/* Returns the hash size for the replacement of md, which is grown if
+ * grow is set.
+ */
+static INT32 next_hashsize(struct mapping_data *md, int grow)
+{
+  if (!md->hashsize) return 1;
+  if (md->hashsize == 1) return grow ? MIN_HASHSIZE : 1;
+  return md->hashsize << grow;
+}
+
 /** This function re-allocates a mapping. It adjusts the max no. of
  * values can be fitted into the mapping. It takes a bit of time to
  * run, but is used seldom enough not to degrade preformance significantly.
@@ -1033,7 +1063,7 @@ PMOD_EXPORT void low_mapping_insert(struct mapping *m,
   if(grow_md || md->refs>1)
   {
     debug_malloc_touch(m);
-    rehash(m, md->hashsize ? md->hashsize << grow_md : AVG_LINK_LENGTH);
+    rehash(m, next_hashsize(md, grow_md));
     md=m->data;
   }
   h=h2 & ( md->hashsize - 1);
@@ -1172,7 +1202,7 @@ PMOD_EXPORT union anything *mapping_get_item_ptr(struct mapping *m,
   if(grow_md || md->refs>1)
   {
     debug_malloc_touch(m);
-    rehash(m, md->hashsize ? md->hashsize << grow_md : AVG_LINK_LENGTH);
+    rehash(m, next_hashsize(md, grow_md));
     md=m->data;
   }
   h=h2 & ( md->hashsize - 1);
@@ -1277,7 +1307,7 @@ PMOD_EXPORT void map_delete_no_free(struct mapping *m,
   if (!(md->flags & MAPPING_FLAG_NO_SHRINK)) {
     if((md->size * MIN_LINK_LENGTH_DENOMINATOR <
 	md->hashsize * MIN_LINK_LENGTH_NUMERATOR) &&
-       (md->hashsize > AVG_LINK_LENGTH)) {
+       (md->hashsize > MIN_HASHSIZE)) {
       debug_malloc_touch(m);
       rehash(m, md->hashsize>>1);
     }
@@ -1355,7 +1385,7 @@ PMOD_EXPORT void check_mapping_for_destruct(struct mapping *m)
     if (!(md->flags & MAPPING_FLAG_NO_SHRINK)) {
       if((md->size * MIN_LINK_LENGTH_DENOMINATOR <
 	  md->hashsize * MIN_LINK_LENGTH_NUMERATOR) &&
-	 (md->hashsize > AVG_LINK_LENGTH)) {
+	 (md->hashsize > MIN_HASHSIZE)) {
 	debug_malloc_touch(m);
 	rehash(m, md->hashsize>>1);
       }
@@ -2659,7 +2689,8 @@ void check_mapping(const struct mapping *m)
   if(md->hashsize > md->num_keypairs)
     Pike_fatal("Pretty mean hashtable there buster %d > %d (2)!\n",md->hashsize,md->num_keypairs);
 
-  if(md->num_keypairs > (md->hashsize + AVG_LINK_LENGTH - 1) * AVG_LINK_LENGTH)
+  if((md->hashsize > 1) &&
+     (md->num_keypairs > (md->hashsize + AVG_LINK_LENGTH - 1) * AVG_LINK_LENGTH))
     Pike_fatal("Mapping from hell detected, attempting to send it back...\n");
 
   if(md->size > 0 && (!md->ind_types || !md->val_types))
@@ -258,10 +258,18 @@ static int parse(struct args *arg)
       if(!aap_get_header(arg, "pragma", H_EXISTS, 0))
 	if((ce = aap_cache_lookup(arg->res.url, arg->res.url_len,
 			      arg->res.host, arg->res.host_len,
-			      arg->cache,0, NULL, NULL)) && ce->data)
+			      arg->cache)) && ce->data)
 	{
-	  ptrdiff_t len = WRITE(arg->fd, ce->data->str, ce->data->len);
-	  LOG(len, arg, atoi(ce->data->str+MINIMUM(ce->data->len, 9)));
+	  char nm[1024];
+	  ptrdiff_t len = aap_cache_not_modified(arg, ce, nm, sizeof(nm));
+	  if(len)
+	  {
+	    len = WRITE(arg->fd, nm, len);
+	    LOG(len, arg, 304);
+	  } else {
+	    len = WRITE(arg->fd, ce->data->str, ce->data->len);
+	    LOG(len, arg, atoi(ce->data->str+MINIMUM(ce->data->len, 9)));
+	  }
 	  simple_aap_free_cache_entry( arg->cache, ce );
 	  /* if keepalive... */
 	  if((arg->res.protocol==s_http_11)
@@ -442,8 +450,6 @@ static void low_accept_loop(struct args *arg)
     } else {
       if(errno == EBADF)
       {
-	int i;
-	struct cache_entry *e, *t;
 	struct cache *c, *p = NULL;
 	struct log *l, *n = NULL;
 	/* oups. */
@@ -462,19 +468,7 @@ static void low_accept_loop(struct args *arg)
 	 *     are protected by the interpreter lock.
 	 */
 	low_mt_lock_interpreter(); /* Can run even if threads_disabled. */
-	for(i=0; i<CACHE_HTABLE_SIZE; i++)
-	{
-	  e = arg->cache->htable[i];
-	  while(e)
-	  {
-	    t = e;
-	    e = e->next;
-	    t->next = 0;
-	    free_string(t->data);
-	    free(t->url);
-	    free(t);
-	  }
-	}
+	aap_cache_flush(arg->cache);
 
 	c = first_cache;
 	while(c && c != arg->cache) {p=c;c = c->next;}
@@ -585,11 +579,10 @@ static void f_accept_with_http_parse(INT32 nargs)
     aap_first_log = log;
   }
   c = calloc(1, sizeof(struct cache));
-  mt_init(&c->mutex);
+  aap_cache_setup(c, ms);
   c->next = first_cache;
   first_cache = c;
   args->cache = c;
-  c->max_size = ms;
   {
       extern struct program *port_program;
       args->fd = ((struct port *)get_storage( port, port_program))->box.fd;
@@ -649,12 +642,24 @@ static void f_accept_with_http_parse(INT32 nargs)
  *!   The number of misses since start
  *! @member int stale
  *!   The number of misses that were stale hits, and not used
+ *! @member int revalidated
+ *!   The number of hits that were answered with 304 Not Modified,
+ *!   since the request had a matching If-None-Match or
+ *!   If-Modified-Since header
+ *! @member int evicted
+ *!   The number of entries removed to make room for new ones
  *! @member int size
  *!   The total current size
  *! @member int entries
  *!   The number of entries in the cache
  *! @member int max_size
  *!   The maximum size of the cache
+ *! @member array(mapping(string:int)) shards
+ *!   The cache is split in independently locked shards, each with
+ *!   its own least recently used eviction. This contains the
+ *!   @expr{"hits"@}, @expr{"misses"@}, @expr{"stale"@},
+ *!   @expr{"revalidated"@}, @expr{"evicted"@}, @expr{"size"@},
+ *!   @expr{"entries"@} and @expr{"max_size"@} of each shard.
  *!
  *! @member int sent_bytes
  *!  The number of bytes sent since the last call to cache_status
@@ -669,17 +674,68 @@ static void f_accept_with_http_parse(INT32 nargs)
 static void f_cache_status(INT32 args)
 {
   struct cache *c = LTHIS->cache;
+  struct cache_shard total;
+  int i;
   pop_n_elems(args);
+
+  memset(&total, 0, sizeof(total));
+  push_static_text("shards");
+  for(i=0; i<c->num_shards; i++)
+  {
+    struct cache_shard *s = &c->shards[i], copy;
+    /* NB: Not locked, since the shard locks may be held by threads
+     *     waiting for the interpreter lock.
+     */
+    copy.hits = s->hits;
+    copy.misses = s->misses;
+    copy.stale = s->stale;
+    copy.revalidated = s->revalidated;
+    copy.evicted = s->evicted;
+    copy.size = s->size;
+    copy.entries = s->entries;
+
+    total.hits += copy.hits;
+    total.misses += copy.misses;
+    total.stale += copy.stale;
+    total.revalidated += copy.revalidated;
+    total.evicted += copy.evicted;
+    total.size += copy.size;
+    total.entries += copy.entries;
+
+    push_static_text("hits");
+    push_int64(copy.hits);
+    push_static_text("misses");
+    push_int64(copy.misses);
+    push_static_text("stale");
+    push_int64(copy.stale);
+    push_static_text("revalidated");
+    push_int64(copy.revalidated);
+    push_static_text("evicted");
+    push_int64(copy.evicted);
+    push_static_text("size");
+    push_int64(copy.size);
+    push_static_text("entries");
+    push_int64(copy.entries);
+    push_static_text("max_size");
+    push_int64(s->max_size);
+    f_aggregate_mapping( 16 );
+  }
+  f_aggregate( c->num_shards );
+
   push_static_text("hits");
-  push_int64(c->hits);
+  push_int64(total.hits);
   push_static_text("misses");
-  push_int64(c->misses);
+  push_int64(total.misses);
   push_static_text("stale");
-  push_int64(c->stale);
+  push_int64(total.stale);
+  push_static_text("revalidated");
+  push_int64(total.revalidated);
+  push_static_text("evicted");
+  push_int64(total.evicted);
   push_static_text("size");
-  push_int64(c->size);
+  push_int64(total.size);
   push_static_text("entries");
-  push_int64(c->entries);
+  push_int64(total.entries);
   push_static_text("max_size");
   push_int64(c->max_size);
 
@@ -690,7 +746,7 @@ static void f_cache_status(INT32 args)
   push_int(c->num_requests);    c->num_requests=0;
   push_static_text("received_bytes");
   push_int(c->received_data);c->received_data=0;
-  f_aggregate_mapping( 18 );
+  f_aggregate_mapping( 24 );
 }
 /*! @endclass
  */
@@ -917,24 +973,12 @@ PIKE_MODULE_EXIT
   while(first_cache)
   {
     int i;
-    struct cache_entry *e, *t;
     struct cache *next;
-    mt_lock(&first_cache->mutex);  /* This lock is _not_ unlocked again.. */
+    /* These locks are _not_ unlocked again.. */
+    for(i=0; i<first_cache->num_shards; i++)
+      mt_lock(&first_cache->shards[i].mutex);
     next = first_cache->next;
-    for(i=0; i<CACHE_HTABLE_SIZE; i++)
-    {
-      e = first_cache->htable[i];
-      while(e)
-      {
-	t = e;
-	e = e->next;
-	t->next = 0;
-        free_string(t->data);
-	free(t->url);
-	free(t);
-      }
-      first_cache->htable[i]=0;
-    }
+    aap_cache_flush(first_cache);
     first_cache->next = NULL;
     first_cache = next;
   }
@@ -5,7 +5,13 @@
 */
 
 /* #define AAP_DEBUG 1 */
-#define CACHE_HTABLE_SIZE 40951
+
+/* The cache is split into up to CACHE_SHARDS independently locked
+ * shards, each at least CACHE_MIN_SHARD_SIZE bytes large.
+ */
+#define CACHE_SHARDS 16
+#define CACHE_SHARD_HTABLE_SIZE 4093
+#define CACHE_MIN_SHARD_SIZE (1024*1024)
 
 #if !defined(__NT__) && !defined(__WIN32__)
 #define HAVE_TIMEOUTS
@@ -38,12 +44,19 @@ struct res
 struct cache_entry
 {
   struct cache_entry *next;
+  struct cache_entry *lru_prev, *lru_next;
   struct pike_string *data;
   time_t stale_at;
   char *url;
   ptrdiff_t url_len;
   char *host;
   ptrdiff_t host_len;
+  /* Validators from the headers in data, used for conditional requests. */
+  char *etag;
+  ptrdiff_t etag_len;
+  char *last_modified;
+  ptrdiff_t last_modified_len;
+  size_t hv;
   int refs;
 };
 
@@ -74,13 +87,22 @@ struct filesystem
 #endif
 };
 
-struct cache
+struct cache_shard
 {
   PIKE_MUTEX_T mutex;
-  struct cache *next;
-  struct cache_entry *htable[CACHE_HTABLE_SIZE];
+  struct cache_entry *htable[CACHE_SHARD_HTABLE_SIZE];
+  /* All entries in the shard, most recently used first. */
+  struct cache_entry *lru_head, *lru_tail;
   UINT64 size, entries, max_size;
-  UINT64 hits, misses, stale;
+  UINT64 hits, misses, stale, revalidated, evicted;
+};
+
+struct cache
+{
+  struct cache *next;
+  struct cache_shard shards[CACHE_SHARDS];
+  int num_shards;
+  UINT64 max_size;
   size_t num_requests, sent_data, received_data;
   int gone;
 };
@@ -28,6 +28,9 @@
 #include "backend.h"
 #include "pike_embed.h"
 
+#define STRING(X,Y) extern struct pike_string *X
+#include "static_strings.h"
+#undef STRING
 
 struct cache *first_cache;
 
@@ -131,162 +134,303 @@ void aap_enqueue_string_to_free( struct pike_string *s )
   mt_unlock( &tofree_mutex );
 }
 
-static size_t cache_hash(char *s, ptrdiff_t len)
+static size_t cache_hash(char *s, ptrdiff_t len, char *ho, ptrdiff_t hlen)
 {
-  size_t res = len * 9471111;
+  size_t res = (len + hlen) * 9471111;
   while(len--) { res=res<<1 ^ ((res&(~0x7ffffff))>>31); res ^= s[len]; }
-  return (res % CACHE_HTABLE_SIZE)/2;
-} /*                              ^^ OBS! */
-
-static void really_free_cache_entry(struct cache  *c, struct cache_entry *e,
-				    struct cache_entry *prev, size_t b)
-{
-#ifdef DEBUG
-  if(d_flag>2)
-  {
-    if(b!=(cache_hash(e->url, e->url_len) +
-	   cache_hash(e->host, e->host_len)))
-      Pike_fatal("Cache entry did not hash to the same spot\n");
-    if(!mt_trylock( & c->mutex ))
-      Pike_fatal("Cache free_entry running unlocked\n");
-    if(prev && prev->next != e)
-      Pike_fatal("prev->next != e\n");
-  }
-#endif
-  if(!prev)
-    c->htable[ b ] = e->next;
-  else
-    prev->next = e->next;
-
-  c->size -= e->data->len;
-  c->entries--;
-  low_free_cache_entry( e );
+  while(hlen--) { res=res<<1 ^ ((res&(~0x7ffffff))>>31); res ^= ho[hlen]; }
+  return res;
 }
 
+#define SHARD(C,HV)	(&(C)->shards[(HV) % (C)->num_shards])
+#define BUCKET(C,HV)	(((HV) / (C)->num_shards) % CACHE_SHARD_HTABLE_SIZE)
 
+static void lru_unlink(struct cache_shard *s, struct cache_entry *e)
+{
+  if(e->lru_prev) e->lru_prev->lru_next = e->lru_next;
+  else s->lru_head = e->lru_next;
+  if(e->lru_next) e->lru_next->lru_prev = e->lru_prev;
+  else s->lru_tail = e->lru_prev;
+  e->lru_prev = e->lru_next = NULL;
+}
 
+static void lru_push(struct cache_shard *s, struct cache_entry *e)
+{
+  e->lru_prev = NULL;
+  e->lru_next = s->lru_head;
+  if(s->lru_head) s->lru_head->lru_prev = e;
+  else s->lru_tail = e;
+  s->lru_head = e;
+}
 
-void aap_free_cache_entry(struct cache *c, struct cache_entry *e,
-			  struct cache_entry *prev, size_t b)
+/* Remove the entry from the shard, and drop the reference held by the
+ * shard. Must have the shard lock.
+ */
+static void unlink_cache_entry(struct cache *c, struct cache_shard *s,
+			       struct cache_entry *e)
 {
-#ifdef DEBUG
-  if(e->refs<=0)
-    Pike_fatal("Freeing free cache entry\n");
+  struct cache_entry **p = &s->htable[ BUCKET(c, e->hv) ];
+  while(*p && *p != e)
+    p = &(*p)->next;
+#ifdef PIKE_DEBUG
+  if(!*p)
+    Pike_fatal("Cache entry not found in its shard.\n");
 #endif
+  *p = e->next;
+  e->next = NULL;
+  lru_unlink(s, e);
+
+  s->size -= e->data->len;
+  s->entries--;
   if(!--e->refs)
-    really_free_cache_entry(c,e,prev,b);
+    low_free_cache_entry( e );
 }
 
 void simple_aap_free_cache_entry(struct cache *c, struct cache_entry *e)
 {
-  mt_lock( &c->mutex );
-  if(!--e->refs)
+  struct cache_shard *s = SHARD(c, e->hv);
+  int last;
+  mt_lock( &s->mutex );
+  last = !--e->refs;
+  mt_unlock( &s->mutex );
+  /* The shard holds a reference as long as the entry is in it. */
+  if(last)
+    low_free_cache_entry( e );
+}
+
+/* Find the value of the header 'name' (lower case) in the header part
+ * of the reply in data.
+ */
+static char *find_reply_header(struct pike_string *data, const char *name,
+			       ptrdiff_t *len)
+{
+  char *in = data->str, *end = data->str + data->len;
+  ptrdiff_t hl = strlen(name);
+
+  /* Skip the status line. */
+  while(in < end && *in != '\n') in++;
+  while(++in < end)
   {
-    struct cache_entry *t, *p=0;
-    size_t hv = cache_hash(e->url, e->url_len)+cache_hash(e->host,e->host_len);
-    t = c->htable[ hv ];
-    while(t)
+    char *eol = in;
+    ptrdiff_t j;
+    while(eol < end && *eol != '\n') eol++;
+    if(eol == in || (eol == in+1 && *in == '\r'))
+      return NULL;	/* End of headers. */
+    if(eol - in > hl && in[hl] == ':')
     {
-      if( t == e )
+      for(j=0; j<hl; j++)
+	if((in[j]|32) != name[j])
+	  break;
+      if(j == hl)
       {
-	really_free_cache_entry(c,t,p,hv);
-	break;
+	in += hl+1;
+	while(in < eol && *in == ' ') in++;
+	if(eol > in && eol[-1] == '\r') eol--;
+	*len = eol - in;
+	return in;
       }
-      p=t;
-      t=t->next;
     }
+    in = eol;
   }
-  mt_unlock( &c->mutex );
+  return NULL;
 }
 
+/* Compare an entity tag with one in a If-None-Match list, using the
+ * weak comparison function.
+ */
+static int etag_in_list(struct cache_entry *ce, struct pstring *list)
+{
+  char *tag = ce->etag, *p = list->str, *end = list->str + list->len;
+  ptrdiff_t tlen = ce->etag_len;
+
+  if(tlen > 2 && tag[0] == 'W' && tag[1] == '/') { tag += 2; tlen -= 2; }
+  while(p < end)
+  {
+    char *q;
+    while(p < end && (*p == ' ' || *p == ',')) p++;
+    if(p < end && *p == '*')
+      return 1;
+    if(end-p > 2 && p[0] == 'W' && p[1] == '/') p += 2;
+    for(q = p; q < end && *q != ','; q++)
+      ;
+    while(q > p && q[-1] == ' ') q--;
+    if(q-p == tlen && !memcmp(p, tag, tlen))
+      return 1;
+    while(p < end && *p != ',') p++;
+  }
+  return 0;
+}
+
+ptrdiff_t aap_cache_not_modified(struct args *arg, struct cache_entry *ce,
+				 char *buf, size_t buflen)
+{
+  struct pstring h;
+  struct cache_shard *s;
+  int match = 0, n;
+
+  if(!arg->res.protocol || arg->res.protocol == s_http_09)
+    return 0;
+
+  /* Only a cached 200 reply can be revalidated. Other replies, such as
+   * a cached 404, are sent as they are.
+   */
+  if(atoi(ce->data->str+MINIMUM(ce->data->len, 9)) != 200)
+    return 0;
+
+  /* If-None-Match takes precedence over If-Modified-Since. */
+  if(aap_get_header(arg, "if-none-match", H_STRING, &h))
+    match = ce->etag && etag_in_list(ce, &h);
+  else if(ce->last_modified &&
+	  aap_get_header(arg, "if-modified-since", H_STRING, &h))
+    match = (h.len == ce->last_modified_len &&
+	     !memcmp(h.str, ce->last_modified, h.len));
+  if(!match)
+    return 0;
+
+  n = snprintf(buf, buflen, "%s 304 Not Modified\r\n",
+	       arg->res.protocol->str);
+  if(ce->etag && n >= 0 && (size_t)n < buflen)
+    n += snprintf(buf+n, buflen-n, "ETag: %.*s\r\n",
+		  (int)ce->etag_len, ce->etag);
+  if(ce->last_modified && n >= 0 && (size_t)n < buflen)
+    n += snprintf(buf+n, buflen-n, "Last-Modified: %.*s\r\n",
+		  (int)ce->last_modified_len, ce->last_modified);
+  if(n >= 0 && (size_t)n < buflen)
+    n += snprintf(buf+n, buflen-n, "\r\n");
+  if(n < 0 || (size_t)n >= buflen)
+    return 0;
+
+  s = SHARD(arg->cache, ce->hv);
+  mt_lock( &s->mutex );
+  s->revalidated++;
+  mt_unlock( &s->mutex );
+  return n;
+}
 
 void aap_cache_insert(struct cache_entry *ce, struct cache *c)
 {
-  struct cache_entry *head, *p;
+  struct cache_shard *s;
+  struct cache_entry *old;
+  size_t b;
   char *t;
-  size_t hv;
-#ifdef DEBUG
-  extern int d_flag;
-  if((d_flag > 2) && !mt_trylock( & c->mutex ))
-    Pike_fatal("Cache insert running unlocked\n");
-#endif
-  c->size += ce->data->len;
-  if((head = aap_cache_lookup(ce->url, ce->url_len,
-                              ce->host, ce->host_len, c, 1,
-                              &p, &hv)))
+
+  t = malloc( ce->url_len + ce->host_len );
+  memcpy(t,ce->url,ce->url_len);   ce->url = t;   t+=ce->url_len;
+  memcpy(t,ce->host,ce->host_len); ce->host = t;
+  ce->etag = find_reply_header(ce->data, "etag", &ce->etag_len);
+  ce->last_modified = find_reply_header(ce->data, "last-modified",
+					&ce->last_modified_len);
+  ce->hv = cache_hash(ce->url, ce->url_len, ce->host, ce->host_len);
+  ce->refs = 1;
+
+  s = SHARD(c, ce->hv);
+  b = BUCKET(c, ce->hv);
+  mt_lock( &s->mutex );
+  for(old = s->htable[b]; old; old = old->next)
+    if(old->url_len == ce->url_len && old->host_len == ce->host_len
+       && !memcmp(old->url,ce->url,ce->url_len)
+       && !memcmp(old->host,ce->host,ce->host_len))
+    {
+      unlink_cache_entry(c, s, old);
+      break;
+    }
+
+  /* Make room by evicting the least recently used entries. */
+  while(s->lru_tail && s->size + ce->data->len > s->max_size)
   {
-    c->size -= head->data->len;
-    aap_enqueue_string_to_free(head->data);
-    head->data = ce->data;
-    head->stale_at = ce->stale_at;
-    aap_free_cache_entry( c, head, p, hv );
-    free(ce);
-  } else {
-    c->entries++;
-    t = malloc( ce->url_len + ce->host_len );
-    memcpy(t,ce->url,ce->url_len);   ce->url = t;   t+=ce->url_len;
-    memcpy(t,ce->host,ce->host_len); ce->host = t;
-    ce->next = c->htable[hv];
-    ce->refs = 1;
-    c->htable[hv] = ce;
+    s->evicted++;
+    unlink_cache_entry(c, s, s->lru_tail);
   }
+
+  ce->next = s->htable[b];
+  s->htable[b] = ce;
+  lru_push(s, ce);
+  s->size += ce->data->len;
+  s->entries++;
+  mt_unlock( &s->mutex );
 }
 
-struct cache_entry *aap_cache_lookup(char *s, ptrdiff_t len,
+struct cache_entry *aap_cache_lookup(char *url, ptrdiff_t len,
 				     char *ho, ptrdiff_t hlen,
-				     struct cache *c, int nolock,
-				     struct cache_entry **p, size_t *hv)
+				     struct cache *c)
 {
-  size_t h = cache_hash(s, len) + cache_hash(ho,hlen);
-  struct cache_entry *e, *prev=NULL;
+  size_t h = cache_hash(url, len, ho, hlen);
+  struct cache_shard *s = SHARD(c, h);
+  struct cache_entry *e;
 
-  if( hv ) *hv = h;
-  if(!nolock)
-    mt_lock(&c->mutex);
-#ifdef DEBUG
-  else
-  {
-    extern int d_flag;
-    if((d_flag>2) && !mt_trylock( & c->mutex ))
-      Pike_fatal("Cache lookup running unlocked\n");
-  }
-#endif
-  if( p ) *p = 0;
-  e = c->htable[h];
+  mt_lock(&s->mutex);
+  e = s->htable[ BUCKET(c, h) ];
   while(e)
   {
-    if(e->url_len == len && e->host_len == hlen
-       && !memcmp(e->url,s,len)
+    if(e->hv == h && e->url_len == len && e->host_len == hlen
+       && !memcmp(e->url,url,len)
        && !memcmp(e->host,ho,hlen))
     {
-      int t = aap_get_time();
-      if(e->stale_at < t)
+      if(e->stale_at < aap_get_time())
       {
-        aap_free_cache_entry( c, e, prev, h );
-	if(!nolock) mt_unlock(&c->mutex);
+	s->stale++;
+	s->misses++;
+	unlink_cache_entry(c, s, e);
+	mt_unlock(&s->mutex);
 	return 0;
       }
-      c->hits++;
-      /* cache hit. Lets add it to the top of the list */
-      if(c->htable[h] != e)
+      s->hits++;
+      if(s->lru_head != e)
       {
-	if(prev) prev->next = e->next;
-	e->next = c->htable[h];
-	c->htable[h] = e;
+	lru_unlink(s, e);
+	lru_push(s, e);
       }
-      if(!nolock) mt_unlock(&c->mutex);
       e->refs++;
+      mt_unlock(&s->mutex);
       return e;
     }
-    prev = e;
-    if( p ) *p = prev;
     e = e->next;
   }
-  c->misses++;
-  if(!nolock) mt_unlock(&c->mutex);
+  s->misses++;
+  mt_unlock(&s->mutex);
   return 0;
 }
 
+void aap_cache_setup(struct cache *c, UINT64 max_size)
+{
+  int i;
+  c->max_size = max_size;
+  c->num_shards = (int)MINIMUM(max_size / CACHE_MIN_SHARD_SIZE, CACHE_SHARDS);
+  if(c->num_shards < 1)
+    c->num_shards = 1;
+  for(i=0; i<CACHE_SHARDS; i++)
+  {
+    mt_init(&c->shards[i].mutex);
+    c->shards[i].max_size = max_size / c->num_shards;
+  }
+}
+
+void aap_cache_flush(struct cache *c)
+/* Must have the interpreter lock */
+{
+  int i, j;
+  for(i=0; i<c->num_shards; i++)
+  {
+    struct cache_shard *s = &c->shards[i];
+    for(j=0; j<CACHE_SHARD_HTABLE_SIZE; j++)
+    {
+      struct cache_entry *e = s->htable[j], *t;
+      while(e)
+      {
+	t = e;
+	e = e->next;
+	t->next = 0;
+	free_string(t->data);
+	free(t->url);
+	free(t);
+      }
+      s->htable[j] = 0;
+    }
+    s->lru_head = s->lru_tail = NULL;
+    s->size = s->entries = 0;
+  }
+}
+
 void aap_clean_cache(void)
 {
   struct cache *c = first_cache;
@@ -6,18 +6,21 @@
 
 struct cache_entry *aap_cache_lookup(char *s, ptrdiff_t len,
 				     char *h, ptrdiff_t hlen,
-				     struct cache *c, int nl,
-				     struct cache_entry **p,
-				     size_t *hv);
-
-
-void aap_free_cache_entry(struct cache *c, struct cache_entry *e,
-		      struct cache_entry *prev, size_t b);
+				     struct cache *c);
 
 void simple_aap_free_cache_entry(struct cache *c, struct cache_entry *e);
 
 void aap_cache_insert(struct cache_entry *ce, struct cache *c);
 
+ptrdiff_t aap_cache_not_modified(struct args *arg, struct cache_entry *ce,
+				 char *buf, size_t buflen);
+
+void aap_cache_setup(struct cache *c, UINT64 max_size);
+void aap_cache_flush(struct cache *c);
+
+/* The largest reply that is put in the cache. */
+#define CACHE_MAX_ENTRY_SIZE(C)	((C)->max_size / (C)->num_shards / 2)
+
 void aap_clean_cache(void);
 
 void aap_enqueue_string_to_free( struct pike_string *s );
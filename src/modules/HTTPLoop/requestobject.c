@@ -830,13 +830,13 @@ void f_aap_reply_with_cache(INT32 args)
 {
   struct cache_entry *ce;
   struct pike_string *reply;
-  INT_TYPE time_to_keep, t, freed=0;
+  INT_TYPE time_to_keep, t;
   if(!THIS->request)
     Pike_error("Reply already called.\n");
 
   get_all_args(NULL, args, "%S%i", &reply, &time_to_keep);
 
-  if((size_t)reply->len < (size_t)THIS->request->cache->max_size/2)
+  if((size_t)reply->len < (size_t)CACHE_MAX_ENTRY_SIZE(THIS->request->cache))
   {
     struct cache *rc = THIS->request->cache;
     struct args *tr = THIS->request;
@@ -846,42 +846,14 @@ void f_aap_reply_with_cache(INT32 args)
       THIS->request = 0;
       return;
     }
+    add_ref(reply);
     THREADS_ALLOW();
     t = aap_get_time();
-    mt_lock(&rc->mutex);
-    if(rc->size > rc->max_size)
-    {
-      struct cache_entry *p,*pp=0,*ppp=0;
-      ptrdiff_t target = rc->max_size - rc->max_size/3;
-      while((size_t)rc->size > (size_t)target)
-      {
-	int i;
-	freed=0;
-	for(i = 0; i<CACHE_HTABLE_SIZE; i++)
-	{
-	  p = rc->htable[i];
-	  ppp=pp=0;
-	  while(p)
-	  {
-	    ppp = pp;
-	    pp = p;
-	    p = p->next;
-	  }
-	  if(pp) aap_free_cache_entry(rc,pp,ppp,i);
-	  freed++;
-	  if((size_t)rc->size < (size_t)target)
-	    break;
-	}
-	if(!freed)  /* no way.. */
-	  break;
-      }
-    }
     ce = new_cache_entry();
     memset(ce, 0, sizeof(struct cache_entry));
     ce->stale_at = t+time_to_keep;
 
     ce->data = reply;
-    reply->refs++;
 
     ce->url = tr->res.url;
     ce->url_len = tr->res.url_len;
@@ -889,7 +861,6 @@ void f_aap_reply_with_cache(INT32 args)
     ce->host = tr->res.host;
     ce->host_len = tr->res.host_len;
     aap_cache_insert(ce, rc);
-    mt_unlock(&rc->mutex);
     THREADS_DISALLOW();
   }
   pop_stack();
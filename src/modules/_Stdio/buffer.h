@@ -10,8 +10,15 @@ struct _Buffer
   struct svalue output;
   struct pike_string *str;
 
+  /* Strings added by reference in zero copy mode. They logically
+   * follow buffer[offset..len), see io_flatten_segments(). */
+  struct pike_string **segs;
+  size_t first_seg, num_segs, segs_allocated;
+  size_t seg_offset;	/* Bytes already consumed of segs[first_seg]. */
+  size_t seg_bytes;	/* Bytes left in all segments. */
+  size_t zero_copy;	/* Minimum length of strings to reference. */
 
-  INT_TYPE num_malloc, num_move; /* debug mainly, for testsuite*/
+  INT_TYPE num_malloc, num_move, num_copy; /* debug mainly, for testsuite*/
   INT32 locked, locked_move;
   float max_waste;
   char malloced, output_triggered;
@@ -36,21 +43,61 @@ PMOD_EXPORT Buffer *io_buffer_from_object(struct object *o);
 PMOD_EXPORT void io_trim( Buffer *io );
 PMOD_EXPORT ptrdiff_t io_actually_trigger_output( Buffer *io );
 
+/* Copies the referenced segments into the buffer, making all data
+ * contiguous again. Everything except adding strings and writing the
+ * buffer to a file needs this, so io_len(), io_read_pointer() and
+ * io_add_space() do it implicitly. The buffer is always malloced when
+ * there are segments. */
+PIKE_UNUSED_ATTRIBUTE
+static void io_flatten_segments( Buffer *io )
+{
+  size_t i, need = io->len + io->seg_bytes;
+
+  /* Locking flattens the buffer, so this only happens if something
+   * has bypassed io_lock(). */
+  if( io->locked )
+    Pike_error("Can not flatten a locked buffer.\n");
+
+  if( need > io->allocated )
+  {
+    io->buffer = xrealloc( io->buffer, need );
+    io->allocated = need;
+    io->num_malloc++;
+  }
+  for( i = io->first_seg; i < io->num_segs; i++ )
+  {
+    struct pike_string *s = io->segs[i];
+    size_t skip = (i == io->first_seg) ? io->seg_offset : 0;
+    memcpy( io->buffer + io->len, s->str + skip, s->len - skip );
+    io->len += s->len - skip;
+    free_string( s );
+  }
+  io->num_copy += io->seg_bytes;
+  io->first_seg = io->num_segs = 0;
+  io->seg_offset = io->seg_bytes = 0;
+}
+
 PIKE_UNUSED_ATTRIBUTE
 static size_t io_len( Buffer *io )
 {
+  if( UNLIKELY(io->num_segs) )
+    io_flatten_segments( io );
   return io->len-io->offset;
 }
 
 PIKE_UNUSED_ATTRIBUTE
 static unsigned char *io_read_pointer(Buffer *io)
 {
+  if( UNLIKELY(io->num_segs) )
+    io_flatten_segments( io );
   return io->buffer + io->offset;
 }
 
 PIKE_UNUSED_ATTRIBUTE
 static unsigned char *io_add_space( Buffer *io, size_t bytes, int force )
 {
+  if( UNLIKELY(io->num_segs) )
+    io_flatten_segments( io );
   if( io->len == io->offset )
     io->offset = io->len = 0;
   if( !force && io->malloced && !io->locked && io->len+bytes < io->allocated &&
@@ -128,6 +128,16 @@ struct pike_sendfile
   struct iovec *iovs;
   char *buffer;
   ptrdiff_t buf_size;
+
+  /* Link in the queue of transfers waiting for a pool thread. */
+  struct pike_sendfile *next;
+
+  /* Progress reporting. */
+  struct callback *progress_backend_callback;
+  struct svalue progress_callback;
+  INT64 progress_interval;	/* Microseconds. */
+  INT64 next_progress;
+  INT64 reported;
 };
 
 #endif /* _REENTRANT */
@@ -41,6 +41,7 @@
 #include "backend.h"
 #include "module_support.h"
 #include "bignum.h"
+#include "time_stuff.h"
 
 #include "file.h"
 
@@ -98,6 +99,9 @@
 
 #define MMAP_SIZE	0x00100000 /* 1M */
 
+/* Default number of threads in the transfer pool. */
+#define SF_DEFAULT_POOL_SIZE	32
+
 #ifndef MAP_FAILED
 #define MAP_FAILED	((void *)-1)
 #endif /* !MAP_FAILED */
@@ -150,6 +154,23 @@
 
 static struct program *pike_sendfile_prog = NULL;
 
+/*
+ * The transfer pool.
+ *
+ * At most sf_pool_size transfers run at the same time, each in a
+ * thread of its own. Further transfers wait in a FIFO queue until a
+ * pool thread becomes available. All of the state below is protected
+ * by the interpreter lock.
+ */
+static int sf_pool_size = SF_DEFAULT_POOL_SIZE;
+static int sf_pool_threads = 0;
+static struct pike_sendfile *sf_queue_head = NULL;
+static struct pike_sendfile *sf_queue_tail = NULL;
+static int sf_queued = 0;
+static int sf_max_queued = 0;
+static INT64 sf_completed = 0;
+static INT64 sf_total_sent = 0;
+
 /*
  * Struct init code.
  */
@@ -182,6 +203,9 @@ static void exit_pike_sendfile(struct object *UNUSED(o))
 
   if (THIS->backend_callback)
     remove_callback (THIS->backend_callback);
+
+  if (THIS->progress_backend_callback)
+    remove_callback (THIS->progress_backend_callback);
 }
 
 /*
@@ -243,6 +267,11 @@ static void call_callback_and_free(struct callback *cb, void *this_, void *UNUSE
   remove_callback(cb);
   this->backend_callback = NULL;
 
+  if (this->progress_backend_callback) {
+    remove_callback(this->progress_backend_callback);
+    this->progress_backend_callback = NULL;
+  }
+
   if (this->self) {
     /* Make sure we get freed in case of error */
     push_object(this->self);
@@ -255,6 +284,54 @@ static void call_callback_and_free(struct callback *cb, void *this_, void *UNUSE
   pop_stack();
 }
 
+static struct Backend_struct *sf_backend(struct pike_sendfile *this)
+{
+  if (this->to && this->to->box.backend) {
+    return this->to->box.backend;
+  }
+  return default_backend;
+}
+
+static void sf_progress_timeout(struct pike_sendfile *this, INT64 usec)
+{
+  struct timeval tv;
+  tv.tv_sec = usec / 1000000;
+  tv.tv_usec = usec % 1000000;
+  backend_lower_timeout(sf_backend(this), &tv);
+}
+
+/* Backend callback that reports the progress of a running transfer. */
+static void sf_report_progress(struct callback *UNUSED(cb), void *this_,
+			       void *UNUSED(arg))
+{
+  struct pike_sendfile *this = this_;
+  struct timeval now;
+  INT64 now_usec;
+  INT64 sent;
+
+  INACCURATE_GETTIMEOFDAY(&now);
+  now_usec = ((INT64)now.tv_sec) * 1000000 + now.tv_usec;
+
+  if (now_usec < this->next_progress) {
+    sf_progress_timeout(this, this->next_progress - now_usec);
+    return;
+  }
+  this->next_progress = now_usec + this->progress_interval;
+  sf_progress_timeout(this, this->progress_interval);
+
+  /* NB: The worker thread updates sent without holding the
+   *     interpreter lock, so this is only a snapshot.
+   */
+  sent = this->sent;
+  if (sent == this->reported) return;
+  this->reported = sent;
+
+  if (TYPEOF(this->progress_callback) == T_INT) return;
+  push_int64(sent);
+  apply_svalue(&this->progress_callback, 1);
+  pop_stack();
+}
+
 /*
  * Code called in the threaded case.
  */
@@ -737,16 +814,12 @@ void low_do_sendfile(struct pike_sendfile *this)
   /* FIXME: Restore non-blocking mode here? */
 }
 
-static void worker(void *this_)
+/* Called with the interpreter lock held when a transfer is done. */
+static void sf_finish(struct pike_sendfile *this)
 {
-  struct pike_sendfile *this = this_;
   struct Backend_struct *backend;
   struct timeval tv;
 
-  low_do_sendfile(this);
-
-  low_mt_lock_interpreter();	/* Can run even if threads_disabled. */
-
   /*
    * Unlock the fd's
    */
@@ -772,6 +845,9 @@ static void worker(void *this_)
     change_fd_for_box (&this->to->box, -1);
   }
 
+  sf_completed++;
+  sf_total_sent += this->sent;
+
   /* Neither of the following can be done in our current context
    * so we do them from a backend callback.
    * * Call the callback.
@@ -782,9 +858,7 @@ static void worker(void *this_)
     Pike_fatal ("Didn't expect a backend callback to be installed already.\n");
 #endif
 
-  if (!(backend = this->to->box.backend)) {
-    backend = default_backend;
-  }
+  backend = sf_backend(this);
 
   this->backend_callback =
     backend_add_backend_callback(backend, call_callback_and_free, this, 0);
@@ -796,16 +870,82 @@ static void worker(void *this_)
 
   /* Wake up the backend */
   backend_wake_up_backend(backend);
+}
 
-  /* We're gone... */
-  num_threads--;
+/* Called with the interpreter lock held. */
+static struct pike_sendfile *sf_dequeue(void)
+{
+  struct pike_sendfile *this = sf_queue_head;
+  if (this) {
+    if (!(sf_queue_head = this->next)) {
+      sf_queue_tail = NULL;
+    }
+    this->next = NULL;
+    sf_queued--;
+  }
+  return this;
+}
 
-  mt_unlock_interpreter();
+static void worker(void *this_)
+{
+  struct pike_sendfile *this = this_;
+
+  while (this) {
+    low_do_sendfile(this);
+
+    low_mt_lock_interpreter();	/* Can run even if threads_disabled. */
+
+    sf_finish(this);
+
+    /* Continue with the next queued transfer, unless the pool
+     * has been shrunk below the current number of threads.
+     */
+    if ((sf_pool_threads > sf_pool_size) || !(this = sf_dequeue())) {
+      /* We're gone... */
+      sf_pool_threads--;
+      num_threads--;
+    }
+
+    mt_unlock_interpreter();
+  }
 
   /* Die */
   return;
 }
 
+/* Called with the interpreter lock held. */
+static void sf_start_worker(struct pike_sendfile *this)
+{
+  /* It is a good idea to increase num_threads before the thread
+   * is actually created, otherwise the backend (or somebody) may
+   * be hogging the interpreter lock... /Hubbe
+   */
+  sf_pool_threads++;
+  num_threads++;
+
+  /* The worker will have a ref. */
+  th_farm(worker, this);
+}
+
+/* Run the transfer in a pool thread, or queue it if all are busy. */
+static void sf_submit(struct pike_sendfile *this)
+{
+  if (sf_pool_threads < sf_pool_size) {
+    sf_start_worker(this);
+    return;
+  }
+  this->next = NULL;
+  if (sf_queue_tail) {
+    sf_queue_tail->next = this;
+  } else {
+    sf_queue_head = this;
+  }
+  sf_queue_tail = this;
+  if (++sf_queued > sf_max_queued) {
+    sf_max_queued = sf_queued;
+  }
+}
+
 /*
  * Functions callable from Pike code
  */
@@ -860,6 +1000,8 @@ static void sf_create(INT32 args)
    */
   free_svalue(&(THIS->callback));
   SET_SVAL(THIS->callback, T_INT, NUMBER_NUMBER, integer, 0);
+  free_svalue(&(THIS->progress_callback));
+  SET_SVAL(THIS->progress_callback, T_INT, NUMBER_NUMBER, integer, 0);
 
   /* NOTE: The references to the stuff in sf are held by the stack.
    * This means that we can throw errors without needing to clean up.
@@ -867,6 +1009,7 @@ static void sf_create(INT32 args)
 
   memset(&sf, 0, sizeof(struct pike_sendfile));
   SET_SVAL(sf.callback, T_INT, NUMBER_NUMBER, integer, 0);
+  SET_SVAL(sf.progress_callback, T_INT, NUMBER_NUMBER, integer, 0);
 
   get_all_args(NULL, args, "%A%O%l%l%A%o%*",
 	       &(sf.headers), &(sf.from_file), &offset,
@@ -1143,14 +1286,7 @@ static void sf_create(INT32 args)
       sf.from->flags |= FILE_LOCK_FD;
     }
 
-    /* It is a good idea to increase num_threads before the thread
-     * is actually created, otherwise the backend (or somebody) may
-     * be hogging the interpreter lock... /Hubbe
-     */
-    num_threads++;
-
-    /* The worker will have a ref. */
-    th_farm(worker, THIS);
+    sf_submit(THIS);
 #if 0
     {
       /* Failure */
@@ -1166,9 +1302,133 @@ static void sf_create(INT32 args)
   return;
 }
 
+/*! @decl void set_progress_callback(function(int:void) callback, @
+ *!                                  int|float|void interval)
+ *!
+ *! Install a callback that is called with the number of bytes sent
+ *! so far while the transfer is in progress.
+ *!
+ *! The @[callback] is called from the backend associated with the
+ *! destination file at most once every @[interval] seconds (default
+ *! @expr{1.0@}), and only if more data has been sent since the
+ *! previous call. It is not called after the transfer has completed.
+ *!
+ *! Call with @expr{0@} as @[callback] to remove the callback.
+ */
+static void sf_set_progress_callback(INT32 args)
+{
+  struct svalue *cb;
+  FLOAT_TYPE interval = 1.0;
+
+  get_all_args(NULL, args, "%*.%F", &cb, &interval);
+
+  if (!THIS->self) {
+    Pike_error("The transfer is not in progress.\n");
+  }
+  if (interval <= 0.0) {
+    SIMPLE_ARG_TYPE_ERROR("set_progress_callback", 2, "positive int|float");
+  }
+
+  assign_svalue(&THIS->progress_callback, cb);
+  THIS->progress_interval = (INT64)(interval * 1000000.0);
+
+  if (UNSAFE_IS_ZERO(cb)) {
+    if (THIS->progress_backend_callback) {
+      remove_callback(THIS->progress_backend_callback);
+      THIS->progress_backend_callback = NULL;
+    }
+  } else if (!THIS->progress_backend_callback) {
+    struct timeval now;
+    INACCURATE_GETTIMEOFDAY(&now);
+    THIS->next_progress = ((INT64)now.tv_sec) * 1000000 + now.tv_usec +
+      THIS->progress_interval;
+    THIS->progress_backend_callback =
+      backend_add_backend_callback(sf_backend(THIS), sf_report_progress,
+				   THIS, 0);
+    sf_progress_timeout(THIS, THIS->progress_interval);
+  }
+
+  pop_n_elems(args);
+}
+
 /*! @endclass
  */
 
+/*! @decl void set_sendfile_pool_size(int(1..) threads)
+ *!
+ *! Set the maximum number of threads used for running
+ *! @[Stdio.sendfile()] transfers. Transfers started when all of the
+ *! threads are busy are queued, and are run in the order they were
+ *! started as threads become available.
+ *!
+ *! The default is @expr{32@} threads.
+ *!
+ *! @note
+ *!   A transfer occupies its thread until it has completed, so a
+ *!   pool that is too small can stall transfers that depend on each
+ *!   other, e.g. where one transfer reads from a pipe fed by another.
+ *!
+ *! @seealso
+ *!   @[sendfile_pool_status()]
+ */
+static void f_set_sendfile_pool_size(INT32 args)
+{
+  INT_TYPE size;
+
+  get_all_args(NULL, args, "%i", &size);
+
+  if (size < 1) {
+    SIMPLE_ARG_TYPE_ERROR("set_sendfile_pool_size", 1, "int(1..)");
+  }
+  sf_pool_size = (int)size;
+
+  /* Put the new threads to work on any queued transfers. */
+  while ((sf_pool_threads < sf_pool_size) && sf_queue_head) {
+    sf_start_worker(sf_dequeue());
+  }
+
+  pop_n_elems(args);
+}
+
+/*! @decl mapping(string:int) sendfile_pool_status()
+ *!
+ *! Returns statistics about the @[Stdio.sendfile()] thread pool.
+ *!
+ *! @mapping
+ *!   @member int "pool_size"
+ *!     The maximum number of threads, see @[set_sendfile_pool_size()].
+ *!   @member int "threads"
+ *!     The number of threads currently running transfers.
+ *!   @member int "queued"
+ *!     The number of transfers waiting for a thread.
+ *!   @member int "max_queued"
+ *!     The largest number of transfers that have been waiting
+ *!     at the same time.
+ *!   @member int "completed"
+ *!     The number of completed transfers.
+ *!   @member int "sent"
+ *!     The total number of bytes sent by the completed transfers.
+ *! @endmapping
+ */
+static void f_sendfile_pool_status(INT32 args)
+{
+  pop_n_elems(args);
+
+  push_static_text("pool_size");
+  push_int(sf_pool_size);
+  push_static_text("threads");
+  push_int(sf_pool_threads);
+  push_static_text("queued");
+  push_int(sf_queued);
+  push_static_text("max_queued");
+  push_int(sf_max_queued);
+  push_static_text("completed");
+  push_int64(sf_completed);
+  push_static_text("sent");
+  push_int64(sf_total_sent);
+  f_aggregate_mapping(12);
+}
+
 #endif /* _REENTRANT */
 
 /*
@@ -1183,16 +1443,27 @@ void init_stdio_sendfile(void)
                     tArray, T_ARRAY, 0);
   PIKE_MAP_VARIABLE("_callback", OFFSETOF(pike_sendfile, callback),
                     tFuncV(tInt,tMix,tVoid), T_MIXED, 0);
+  PIKE_MAP_VARIABLE("_progress_callback",
+                    OFFSETOF(pike_sendfile, progress_callback),
+                    tOr(tFunc(tInt,tVoid), tZero), T_MIXED, 0);
 
   /* function(array(string),object,int,int,array(string),object,function(int,mixed...:void),mixed...:void) */
   ADD_FUNCTION("create", sf_create,
 	       tFuncV(tArr(tStr) tObj tInt tInt tArr(tStr) tObj
 		      tFuncV(tInt, tMix, tVoid), tMix, tVoid), 0);
+  ADD_FUNCTION("set_progress_callback", sf_set_progress_callback,
+	       tFunc(tOr(tFunc(tInt, tVoid), tZero) tOr3(tInt, tFlt, tVoid),
+		     tVoid), 0);
 
   set_exit_callback(exit_pike_sendfile);
 
   pike_sendfile_prog = end_program();
   add_program_constant("sendfile", pike_sendfile_prog, 0);
+
+  ADD_FUNCTION("set_sendfile_pool_size", f_set_sendfile_pool_size,
+	       tFunc(tInt1Plus, tVoid), 0);
+  ADD_FUNCTION("sendfile_pool_status", f_sendfile_pool_status,
+	       tFunc(tNone, tMap(tStr, tInt)), 0);
 #endif /* _REENTRANT */
 }
 
@@ -40,6 +40,9 @@
 #ifdef HAVE_SYS_SOCKET_H
 #include <sys/socket.h>
 #endif
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
 
 #ifdef HAVE_SYS_TIME_H
 #include <sys/time.h>
@@ -133,13 +136,15 @@ struct udp_storage {
   int protocol;
 
   struct svalue read_callback;	/* Mapped. */
+
+  /* Receive buffer for read_many(), kept between calls. */
+  char *batch_buf;
+  INT_TYPE batch_max;
 };
 
 void zero_udp(struct object *ignored);
 int low_exit_udp(void);
-void exit_udp(struct object *UNUSED(ignored)) {
-  low_exit_udp();
-}
+void exit_udp(struct object *UNUSED(ignored));
 
 #undef THIS
 #define THIS ((struct udp_storage *)Pike_fp->current_storage)
@@ -751,6 +756,85 @@ void udp_wait(INT32 args)
 
 #define UDP_BUFFSIZE 65536
 
+/* Throws an error for a failed recvfrom(), unless it is a condition
+ * that read() reports by returning zero.
+ */
+static void udp_read_error(int e, int flags)
+{
+  switch(e)
+  {
+#ifdef WSAEBADF
+     case WSAEBADF:
+#endif
+     case EBADF:
+	if (THIS->box.backend)
+	  set_fd_callback_events (&THIS->box, 0, 0);
+	Pike_error("Socket closed\n");
+#ifdef ESTALE
+     case ESTALE:
+#endif
+     case EIO:
+	if (THIS->box.backend)
+	  set_fd_callback_events (&THIS->box, 0, 0);
+	Pike_error("I/O error\n");
+     case ENOMEM:
+#ifdef ENOSR
+     case ENOSR:
+#endif /* ENOSR */
+	Pike_error("Out of memory\n");
+#ifdef ENOTSOCK
+     case ENOTSOCK:
+	Pike_fatal("reading from non-socket fd!!!\n");
+#endif
+     case EINVAL:
+       if (!(flags & MSG_OOB)) {
+	 Pike_error("Socket read failed with EINVAL.\n");
+       }
+       /* FALLTHRU */
+     case EWOULDBLOCK:
+	return;
+
+     default:
+	Pike_error("Socket read failed with errno %d.\n", e);
+  }
+}
+
+/* Push a mapping as returned by read(). */
+static void push_udp_packet(char *data, ptrdiff_t len, PIKE_SOCKADDR *from)
+{
+  char buffer[256];
+
+  push_static_text("data");
+  push_string( make_shared_binary_string(data, len) );
+
+  push_static_text("ip");
+#ifdef fd_inet_ntop
+  if (!fd_inet_ntop( SOCKADDR_FAMILY(*from), SOCKADDR_IN_ADDR(*from),
+		     buffer, sizeof(buffer) )) {
+    push_static_text("UNSUPPORTED");
+  } else {
+    /* NOTE: IPv6-mapped IPv4 addresses may only
+     *       connect to other IPv4 addresses.
+     *
+     * Make the Pike-level code believe it has an actual IPv4 address
+     * when getting a mapped address (::FFFF:a.b.c.d).
+     */
+    if ((!strncmp(buffer, "::FFFF:", 7) || !strncmp(buffer, "::ffff:", 7)) &&
+	!strchr(buffer + 7, ':')) {
+      push_text(buffer+7);
+    } else {
+      push_text(buffer);
+    }
+  }
+#else
+  push_text( inet_ntoa( *SOCKADDR_IN_ADDR(*from) ) );
+#endif
+
+  push_constant_text("port");
+  push_int(ntohs(from->ipv4.sin_port));
+  f_aggregate_mapping( 6 );
+}
+
 /*! @decl mapping(string:int|string) read()
  *! @decl mapping(string:int|string) read(int flag)
  *!
@@ -810,78 +894,150 @@ void udp_read(INT32 args)
 
   if(res<0)
   {
-    switch(e)
-    {
-#ifdef WSAEBADF
-       case WSAEBADF:
-#endif
-       case EBADF:
-	  if (THIS->box.backend)
-	    set_fd_callback_events (&THIS->box, 0, 0);
-	  Pike_error("Socket closed\n");
-#ifdef ESTALE
-       case ESTALE:
-#endif
-       case EIO:
-	  if (THIS->box.backend)
-	    set_fd_callback_events (&THIS->box, 0, 0);
-	  Pike_error("I/O error\n");
-       case ENOMEM:
-#ifdef ENOSR
-       case ENOSR:
-#endif /* ENOSR */
-	  Pike_error("Out of memory\n");
-#ifdef ENOTSOCK
-       case ENOTSOCK:
-	  Pike_fatal("reading from non-socket fd!!!\n");
-#endif
-       case EINVAL:
-	 if (!(flags & MSG_OOB)) {
-	   Pike_error("Socket read failed with EINVAL.\n");
-	 }
-	 /* FALLTHRU */
-       case EWOULDBLOCK:
-	  push_int( 0 );
-	  return;
-
-       default:
-	  Pike_error("Socket read failed with errno %d.\n", e);
-    }
+    udp_read_error(e, flags);
+    push_int( 0 );
+    return;
   }
   /* Now comes the interresting part.
    * make a nice mapping from this stuff..
    */
-  push_static_text("data");
-  push_string( make_shared_binary_string(buffer, res) );
+  push_udp_packet(buffer, res, &from);
 
-  push_static_text("ip");
-#ifdef fd_inet_ntop
-  if (!fd_inet_ntop( SOCKADDR_FAMILY(from), SOCKADDR_IN_ADDR(from),
-		     buffer, sizeof(buffer) )) {
-    push_static_text("UNSUPPORTED");
-  } else {
-    /* NOTE: IPv6-mapped IPv4 addresses may only
-     *       connect to other IPv4 addresses.
-     *
-     * Make the Pike-level code believe it has an actual IPv4 address
-     * when getting a mapped address (::FFFF:a.b.c.d).
-     */
-    if ((!strncmp(buffer, "::FFFF:", 7) || !strncmp(buffer, "::ffff:", 7)) &&
-	!strchr(buffer + 7, ':')) {
-      push_text(buffer+7);
-    } else {
-      push_text(buffer);
-    }
+  if (!(THIS->inet_flags & PIKE_INET_FLAG_NB))
+    INVALIDATE_CURRENT_TIME();
+}
+
+/* The maximum number of datagrams handled by one system call in
+ * read_many() and send_many().
+ */
+#define UDP_MAX_BATCH 64
+
+/*! @decl array(mapping(string:int|string)) read_many(int(1..) max)
+ *!
+ *! Read up to @[max] datagrams from the UDP socket, with as few
+ *! system calls as possible (@tt{recvmmsg(2)@} where available).
+ *!
+ *! In blocking mode this waits for the first datagram, and then
+ *! returns it together with any other datagrams that have already
+ *! arrived. In nonblocking mode only the datagrams that have already
+ *! arrived are returned.
+ *!
+ *! At most 64 datagrams are returned, even if @[max] is larger.
+ *!
+ *! @returns
+ *!   An array of mappings like the ones returned by @[read()]. The
+ *!   array is empty if no datagrams were available in nonblocking
+ *!   mode.
+ *!
+ *! @seealso
+ *!   @[read()], @[send_many()], @[set_read_many_callback()]
+ */
+static void udp_read_many(INT32 args)
+{
+  INT_TYPE max, buf_max;
+  int fd, e, i;
+  ptrdiff_t res;
+  int nb = THIS->inet_flags & PIKE_INET_FLAG_NB;
+  char *buf;
+  PIKE_SOCKADDR from[UDP_MAX_BATCH];
+  ptrdiff_t len[UDP_MAX_BATCH];
+#ifdef HAVE_RECVMMSG
+  struct mmsghdr msgs[UDP_MAX_BATCH];
+  struct iovec iov[UDP_MAX_BATCH];
+#else
+  ACCEPT_SIZE_T fromlen[UDP_MAX_BATCH];
+#endif
+
+  get_all_args(NULL, args, "%+", &max);
+  if (!max)
+    SIMPLE_ARG_TYPE_ERROR("read_many", 1, "int(1..)");
+  if (max > UDP_MAX_BATCH)
+    max = UDP_MAX_BATCH;
+  pop_n_elems(args);
+
+  fd = FD;
+  if (fd < 0)
+    Pike_error("Not open\n");
+
+  /* Take the buffer, in case another thread calls us while the
+   * interpreter lock is released.
+   */
+  buf = THIS->batch_buf;
+  buf_max = THIS->batch_max;
+  THIS->batch_buf = NULL;
+  THIS->batch_max = 0;
+  if (!buf || buf_max < max) {
+    if (buf) free(buf);
+    buf = xalloc(max * UDP_BUFFSIZE);
+    buf_max = max;
   }
+
+  do {
+    THREADS_ALLOW();
+#ifdef HAVE_RECVMMSG
+    for (i = 0; i < max; i++) {
+      iov[i].iov_base = buf + i * UDP_BUFFSIZE;
+      iov[i].iov_len = UDP_BUFFSIZE;
+      memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+      msgs[i].msg_hdr.msg_name = from + i;
+      msgs[i].msg_hdr.msg_namelen = sizeof(from[i]);
+      msgs[i].msg_hdr.msg_iov = iov + i;
+      msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+    /* MSG_WAITFORONE: Only block for the first datagram. */
+    res = recvmmsg(fd, msgs, max, MSG_WAITFORONE, NULL);
+    e = errno;
+    for (i = 0; i < res; i++)
+      len[i] = msgs[i].msg_len;
 #else
-  push_text( inet_ntoa( *SOCKADDR_IN_ADDR(from) ) );
+    for (res = 0; res < max; res++) {
+      ptrdiff_t n;
+      int flags = 0;
+      if (res) {
+#ifdef MSG_DONTWAIT
+	flags = MSG_DONTWAIT;
+#else
+	/* Reading more would block a blocking socket. */
+	if (!nb) break;
 #endif
+      }
+      fromlen[res] = sizeof(from[res]);
+      n = fd_recvfrom(fd, buf + res * UDP_BUFFSIZE, UDP_BUFFSIZE, flags,
+		      (struct sockaddr *)(from + res), fromlen + res);
+      if (n < 0) break;
+      len[res] = n;
+    }
+    e = errno;
+    if (!res) res = -1;
+#endif
+    THREADS_DISALLOW();
 
-  push_constant_text("port");
-  push_int(ntohs(from.ipv4.sin_port));
-  f_aggregate_mapping( 6 );
+    check_threads_etc();
+  } while((res==-1) && (e==EINTR));
 
-  if (!(THIS->inet_flags & PIKE_INET_FLAG_NB))
+  for (i = 0; i < res; i++)
+    push_udp_packet(buf + i * UDP_BUFFSIZE, len[i], from + i);
+
+  if (THIS->batch_buf && THIS->batch_max >= buf_max) {
+    /* Another thread has attached a buffer at least as large
+     * meanwhile. */
+    free(buf);
+  } else {
+    if (THIS->batch_buf) free(THIS->batch_buf);
+    THIS->batch_buf = buf;
+    THIS->batch_max = buf_max;
+  }
+
+  if (res < 0) {
+    THIS->my_errno = errno = e;
+    udp_read_error(e, 0);
+    push_empty_array();
+    return;
+  }
+  THIS->my_errno = 0;
+  f_aggregate(res);
+
+  if (!nb)
     INVALIDATE_CURRENT_TIME();
 }
 
@@ -1000,6 +1156,161 @@ void udp_sendto(INT32 args)
     INVALIDATE_CURRENT_TIME();
 }
 
+/*! @decl int send_many(array(array(string|int)) packets)
+ *! @decl int send_many(array(array(string|int)) packets, int flags)
+ *!
+ *! Send several datagrams, with as few system calls as possible
+ *! (@tt{sendmmsg(2)@} where available).
+ *!
+ *! Each element in @[packets] is an array
+ *! @expr{({ to, port, message })@} with the same meaning as the
+ *! arguments to @[send()]. @[flags] is also the same as for
+ *! @[send()].
+ *!
+ *! Sending stops at the first datagram that fails.
+ *!
+ *! @returns
+ *!   The number of datagrams that were sent, or @expr{-1@} if the
+ *!   first one failed. Check @[errno()] for the cause, as for
+ *!   @[send()].
+ *!
+ *! @throws
+ *!   Throws errors on invalid arguments and uninitialized object.
+ *!
+ *! @seealso
+ *!   @[send()], @[read_many()]
+ */
+static void udp_send_many(INT32 args)
+{
+  struct array *a;
+  INT_TYPE fl = 0;
+  int flags = 0, fd, e = 0, i;
+  ptrdiff_t res = 0, sent = 0;
+  PIKE_SOCKADDR to[UDP_MAX_BATCH];
+  int to_len[UDP_MAX_BATCH];
+  struct pike_string *msg[UDP_MAX_BATCH];
+#ifdef HAVE_SENDMMSG
+  struct mmsghdr msgs[UDP_MAX_BATCH];
+  struct iovec iov[UDP_MAX_BATCH];
+#endif
+
+  if(FD < 0)
+    Pike_error("UDP: not open\n");
+
+  get_all_args(NULL, args, "%a.%i", &a, &fl);
+
+  if(fl & 1) {
+    flags |= MSG_OOB;
+  }
+  if(fl & 2) {
+#ifdef MSG_DONTROUTE
+    flags |= MSG_DONTROUTE;
+#endif /* MSG_DONTROUTE */
+  }
+  if(fl & ~3) {
+    Pike_error("Illegal flags argument.\n");
+  }
+
+  for (i = 0; i < a->size; i++) {
+    struct array *p;
+    if ((TYPEOF(ITEM(a)[i]) != PIKE_T_ARRAY) ||
+	((p = ITEM(a)[i].u.array)->size != 3) ||
+	(TYPEOF(ITEM(p)[0]) != PIKE_T_STRING) ||
+	((TYPEOF(ITEM(p)[1]) != PIKE_T_STRING) &&
+	 (TYPEOF(ITEM(p)[1]) != PIKE_T_INT)) ||
+	(TYPEOF(ITEM(p)[2]) != PIKE_T_STRING) ||
+	ITEM(p)[2].u.string->size_shift) {
+      SIMPLE_ARG_TYPE_ERROR("send_many", 1,
+			    "array(array(string|int))");
+    }
+  }
+
+  fd = FD;
+  while (sent < a->size) {
+    int cnt = (int)MINIMUM(a->size - sent, UDP_MAX_BATCH);
+
+    for (i = 0; i < cnt; i++) {
+      struct array *p = ITEM(a)[sent + i].u.array;
+      to_len[i] = get_inet_addr(to + i, ITEM(p)[0].u.string->str,
+				(TYPEOF(ITEM(p)[1]) == PIKE_T_STRING?
+				 ITEM(p)[1].u.string->str : NULL),
+				(TYPEOF(ITEM(p)[1]) == PIKE_T_INT?
+				 ITEM(p)[1].u.integer : -1),
+				THIS->inet_flags);
+    }
+    /* The array may be changed by other threads while sending. */
+    for (i = 0; i < cnt; i++)
+      copy_shared_string(msg[i], ITEM(ITEM(a)[sent + i].u.array)[2].u.string);
+    INVALIDATE_CURRENT_TIME();
+
+    do {
+      THREADS_ALLOW();
+#ifdef HAVE_SENDMMSG
+      for (i = 0; i < cnt; i++) {
+	iov[i].iov_base = msg[i]->str;
+	iov[i].iov_len = msg[i]->len;
+	memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+	msgs[i].msg_hdr.msg_name = to + i;
+	msgs[i].msg_hdr.msg_namelen = to_len[i];
+	msgs[i].msg_hdr.msg_iov = iov + i;
+	msgs[i].msg_hdr.msg_iovlen = 1;
+      }
+      res = sendmmsg(fd, msgs, cnt, flags);
+      e = errno;
+#else
+      for (res = 0; res < cnt; res++) {
+	if (fd_sendto(fd, msg[res]->str, msg[res]->len, flags,
+		      (struct sockaddr *)(to + res), to_len[res]) < 0)
+	  break;
+      }
+      e = errno;
+      if (!res) res = -1;
+#endif
+      THREADS_DISALLOW();
+
+      check_threads_etc();
+    } while((res == -1) && e==EINTR);
+
+    for (i = 0; i < cnt; i++)
+      free_string(msg[i]);
+
+    if (res < cnt) {
+      if (res > 0) sent += res;
+      break;
+    }
+    sent += res;
+  }
+
+  if (!sent && a->size)
+  {
+    THIS->my_errno = e;
+    switch(e)
+    {
+       case EBADF:
+	  if (THIS->box.backend)
+	    set_fd_callback_events (&THIS->box, 0, 0);
+	  Pike_error("Socket closed\n");
+       case ENOMEM:
+#ifdef ENOSR
+       case ENOSR:
+#endif /* ENOSR */
+	  Pike_error("Out of memory\n");
+       case EINVAL:
+#ifdef ENOTSOCK
+       case ENOTSOCK:
+#endif
+	  if (THIS->box.backend)
+	    set_fd_callback_events (&THIS->box, 0, 0);
+	  Pike_error("Not a socket!!!\n");
+    }
+    sent = -1;
+  }
+  pop_n_elems(args);
+  push_int64(sent);
+  if (!(THIS->inet_flags & PIKE_INET_FLAG_NB))
+    INVALIDATE_CURRENT_TIME();
+}
+
 
 static int got_udp_event (struct fd_callback_box *box, int DEBUGUSED(event))
 {
@@ -1032,9 +1343,20 @@ void zero_udp(struct object *o)
   THIS->inet_flags = PIKE_INET_FLAG_UDP;
   THIS->type=SOCK_DGRAM;
   THIS->protocol=0;
+  THIS->batch_buf = NULL;
+  THIS->batch_max = 0;
   /* map_variable handles read_callback. */
 }
 
+void exit_udp(struct object *UNUSED(ignored))
+{
+  low_exit_udp();
+  if (THIS->batch_buf) {
+    free(THIS->batch_buf);
+    THIS->batch_buf = NULL;
+  }
+}
+
 int low_exit_udp()
 {
   int fd = FD;
@@ -1456,6 +1778,9 @@ void init_stdio_udp(void)
   ADD_FUNCTION("read",udp_read,
 	       tFunc(tOr(tInt,tVoid),tMap(tStr,tOr(tInt,tStr))),0);
 
+  ADD_FUNCTION("read_many",udp_read_many,
+	       tFunc(tIntPos,tArr(tMap(tStr,tOr(tInt,tStr)))),0);
+
   add_integer_constant("MSG_OOB", 1, 0);
 #ifdef MSG_PEEK
   add_integer_constant("MSG_PEEK", 2, 0);
@@ -1464,6 +1789,9 @@ void init_stdio_udp(void)
   ADD_FUNCTION("send",udp_sendto,
 	       tFunc(tStr tOr(tInt,tStr) tStr tOr(tVoid,tInt),tInt),0);
 
+  ADD_FUNCTION("send_many",udp_send_many,
+	       tFunc(tArr(tArr(tOr(tStr,tInt))) tOr(tVoid,tInt),tInt),0);
+
   ADD_FUNCTION("connect",udp_connect,
 	       tFunc(tString tOr(tInt,tStr),tInt),0);
 
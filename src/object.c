@@ -1507,6 +1507,35 @@ PMOD_EXPORT int object_index_no_free2(struct svalue *to,
   }
 }
 
+/* Fast path for o->name from the opcodes, where name is
+ * caller->strings[string_no]. The identifier is looked up through
+ * the inline cache of the call site. Returns 0 without touching to
+ * if the generic path has to be taken. */
+PMOD_EXPORT int object_arrow_cached_no_free(struct svalue *to,
+					    struct object *o,
+					    int inherit_number,
+					    struct program *caller,
+					    int string_no)
+{
+  struct program *p;
+  struct inherit *inh;
+  int f;
+
+  if(!(p = o->prog) || !(p->flags & PROGRAM_FIXED))
+    return 0;
+
+  p = (inh = p->inherits + inherit_number)->prog;
+  if(p->lfuns[LFUN_ARROW] != -1)
+    return 0;
+
+  f = find_cached_identifier(caller, string_no, p);
+  if(f < 0)
+    SET_SVAL(*to, T_INT, NUMBER_UNDEFINED, integer, 0);
+  else
+    low_object_index_no_free(to, o, f + inh->identifier_level);
+  return 1;
+}
+
 #define ARROW_INDEX_P(X) (TYPEOF(*(X)) == T_STRING && SUBTYPEOF(*(X)))
 
 /* Get a variable through external indexing, i.e. by going through
@@ -3448,8 +3477,12 @@ PMOD_EXPORT enum memobj_type get_memory_object_memory( struct object *o, void **
 
   if( (src.io = io_buffer( o )) )
   {
+    /* Only a pointer needs the segments copied in. A locked buffer
+     * never has segments, see io_lock(). */
+    if( ptr && src.io->num_segs )
+      io_flatten_segments(src.io);
     if( shift ) *shift=0;
-    if( len ) *len = src.io->len-src.io->offset;
+    if( len ) *len = src.io->len-src.io->offset+src.io->seg_bytes;
     if( ptr ) *ptr=src.io->buffer+src.io->offset;
     return MEMOBJ_STDIO_IOBUFFER;
   }
@@ -115,6 +115,11 @@ PMOD_EXPORT int object_index_no_free(struct svalue *to,
 				     struct object *o,
 				     int inherit_level,
 				     struct svalue *key);
+PMOD_EXPORT int object_arrow_cached_no_free(struct svalue *to,
+					    struct object *o,
+					    int inherit_number,
+					    struct program *caller,
+					    int string_no);
 PMOD_EXPORT void object_low_set_index(struct object *o,
 				      int f,
 				      struct svalue *from);
@@ -50,6 +50,17 @@ static ptrdiff_t _parse_JSON_string_utf8(PCHARP str, ptrdiff_t pos, ptrdiff_t en
 	#line 144 "rl/json_string_utf8.rl"
 	
 	
+	if ((pe - p > 1) && (*p == '"')) {
+		/* Fast path for US-ASCII strings without escapes, which are
+		* copied as is. */
+		ptrdiff_t n = json_scan_plain(p + 1, pe - p - 1, 1);
+		if ((n < pe - p - 1) && (p[n + 1] == '"')) {
+			if (validate)
+				push_string(make_shared_binary_string((const char *)p + 1, n));
+			return pos + n + 2;
+		}
+	}
+	
 	if (validate) {
 		init_string_builder(&s, 0);
 		SET_ONERROR(handle, free_string_builder, &s);
@@ -60,7 +71,7 @@ static ptrdiff_t _parse_JSON_string_utf8(PCHARP str, ptrdiff_t pos, ptrdiff_t en
 		cs = (int)JSON_string_start;
 	}
 	
-	#line 151 "rl/json_string_utf8.rl"
+	#line 162 "rl/json_string_utf8.rl"
 	
 	
 	{
@@ -902,7 +913,7 @@ static ptrdiff_t _parse_JSON_string_utf8(PCHARP str, ptrdiff_t pos, ptrdiff_t en
 		_out: {}
 	}
 	
-	#line 152 "rl/json_string_utf8.rl"
+	#line 163 "rl/json_string_utf8.rl"
 	
 	
 	if (cs >= JSON_string_first_final) {
@@ -107,6 +107,17 @@ static ptrdiff_t _parse_JSON_string(PCHARP str, ptrdiff_t p, ptrdiff_t pe, struc
 
     %% write data;
 
+    if (!str.shift && (pe - p > 1) && (((p_wchar0 *)str.ptr)[p] == '"')) {
+	/* Fast path for strings without escapes, which are copied as is. */
+	const p_wchar0 *s0 = (const p_wchar0 *)str.ptr + p + 1;
+	ptrdiff_t n = json_scan_plain(s0, pe - p - 1, 0);
+	if ((n < pe - p - 1) && (s0[n] == '"')) {
+	    if (validate)
+		push_string(make_shared_binary_string((const char *)s0, n));
+	    return p + n + 2;
+	}
+    }
+
     if (validate) {
 	init_string_builder(&s, 0);
 	SET_ONERROR (handle, free_string_builder, &s);
@@ -8,6 +8,10 @@
 #define SHUFFLER_CONFIG_H
 
 @TOP@
+
+/* Define this if your <sys/sendfile.h> is broken. */
+#undef HAVE_BROKEN_SYS_SENDFILE_H
+
 @BOTTOM@
 
 #endif
@@ -5,6 +5,7 @@
 */
 
 #include "global.h"
+#include "config.h"
 #include "bignum.h"
 #include "object.h"
 #include "interpret.h"
@@ -15,6 +16,12 @@
 
 #include <sys/stat.h>
 
+#if defined(HAVE_SENDFILE) && defined(HAVE_SYS_SENDFILE_H) && \
+    !defined(HAVE_BROKEN_SYS_SENDFILE_H)
+#include <sys/sendfile.h>
+#define SHUFFLER_SENDFILE
+#endif
+
 #include "shuffler.h"
 
 #define CHUNK 8192
@@ -59,9 +66,60 @@ static struct data get_data( struct source *src, off_t len )
 
   if( rr<0 || rr < len )
     s->s.eof = 1;
+  else
+    s->len -= rr;
   return res;
 }
 
+#ifdef SHUFFLER_SENDFILE
+static ptrdiff_t send_to_fd( struct source *src, int to, off_t len )
+{
+  struct fd_source *s = (struct fd_source *)src;
+  ptrdiff_t sent;
+  int e;
+
+  if( len > s->len )
+    len = s->len;
+
+  THREADS_ALLOW();
+  do {
+    /* NULL offset: Use and update the file position, like fd_read. */
+    sent = sendfile( to, s->fd, NULL, len );
+  } while( (sent < 0) && (errno == EINTR) );
+  e = errno;
+  THREADS_DISALLOW();
+
+  if( sent >= 0 )
+  {
+    s->len -= sent;
+    /* A zero return means that the file is shorter than expected. */
+    if( !sent || !s->len )
+      s->s.eof = 1;
+    return sent;
+  }
+
+  switch( e )
+  {
+    case EAGAIN:
+#if defined(EWOULDBLOCK) && (EWOULDBLOCK != EAGAIN)
+    case EWOULDBLOCK:
+#endif
+      return 0;
+    case EINVAL:
+    case ENOSYS:
+      /* Not supported for this destination. Nothing has been consumed
+       * from the file, so just use the copy path from now on.
+       */
+      s->s.send_to_fd = NULL;
+      return SOURCE_FD_COPY;
+    case EIO:
+      return SOURCE_FD_READ_ERROR;
+  }
+  errno = e;
+  return -1;
+}
+#endif
+
 
 static void free_source( struct source *src )
 {
@@ -103,6 +161,9 @@ struct source *source_normal_file_make( struct svalue *s,
   pop_stack();
   res->s.get_data = get_data;
   res->s.free_source = free_source;
+#ifdef SHUFFLER_SENDFILE
+  res->s.send_to_fd = send_to_fd;
+#endif
   res->obj = s->u.object;
   add_ref(res->obj);
 
@@ -5,9 +5,11 @@
 */
 
 #include "global.h"
+#include "config.h"
 #include "bignum.h"
 #include "object.h"
 #include "interpret.h"
+#include "threads.h"
 
 #include "fdlib.h"
 #include "fd_control.h"
@@ -15,6 +17,14 @@
 
 #include <sys/stat.h>
 
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+
+#if defined(HAVE_SPLICE) && defined(HAVE_PIPE) && defined(SPLICE_F_NONBLOCK)
+#define SHUFFLER_SPLICE
+#endif
+
 #include "shuffler.h"
 
 #define CHUNK 8192
@@ -38,6 +48,21 @@ struct fd_source
   void (*when_data_cb)( void *a );
   void *when_data_cb_arg;
   INT64 len, skip;
+
+#ifdef SHUFFLER_SPLICE
+  /* splice(2) needs a pipe at one end, so data is moved from fd to the
+   * destination through pipe_fds. The pipe is created the first time
+   * it is needed. 'piped' is the number of bytes that are in the pipe,
+   * but not yet written to the destination.
+   *
+   * The fd might be in blocking mode, so it is only read from after
+   * read_callback has reported it as readable.
+   */
+  int pipe_fds[2];
+  int piped;
+  int waiting, readable;
+  int dest_ok;
+#endif
 };
 
 
@@ -45,8 +70,14 @@ static void read_callback( int fd, struct fd_source *s );
 static void setup_callbacks( struct source *src )
 {
   struct fd_source *s = (struct fd_source *)src;
-  if( !s->available )
-    set_read_callback( s->fd, (void*)read_callback, s );
+  if( s->available )
+    return;
+#ifdef SHUFFLER_SPLICE
+  /* When splicing, only wake up when send_to_fd has run out of data. */
+  if( s->s.send_to_fd && !s->waiting )
+    return;
+#endif
+  set_read_callback( s->fd, (void*)read_callback, s );
 }
 
 static void remove_callbacks( struct source *src )
@@ -84,9 +115,154 @@ static struct data get_data( struct source *src, off_t UNUSED(len) )
 }
 
 
+#ifdef SHUFFLER_SPLICE
+static void close_pipe( struct fd_source *s )
+{
+  if( s->pipe_fds[0] >= 0 )
+  {
+    fd_close( s->pipe_fds[0] );
+    fd_close( s->pipe_fds[1] );
+    s->pipe_fds[0] = s->pipe_fds[1] = -1;
+  }
+  s->piped = 0;
+}
+
+static int open_pipe( struct fd_source *s )
+{
+  if( pipe( s->pipe_fds ) )
+  {
+    s->pipe_fds[0] = s->pipe_fds[1] = -1;
+    return 0;
+  }
+  set_close_on_exec( s->pipe_fds[0], 1 );
+  set_close_on_exec( s->pipe_fds[1], 1 );
+  set_nonblocking( s->pipe_fds[0], 1 );
+  set_nonblocking( s->pipe_fds[1], 1 );
+  return 1;
+}
+
+static ptrdiff_t to_copy_path( struct fd_source *s )
+{
+  close_pipe( s );
+  s->s.send_to_fd = NULL;
+  s->waiting = 0;
+  setup_callbacks( (struct source *)s );
+  return SOURCE_FD_COPY;
+}
+
+static ptrdiff_t send_to_fd( struct source *src, int to, off_t len )
+{
+  struct fd_source *s = (struct fd_source *)src;
+  ptrdiff_t n;
+  int e;
+
+  if( !s->piped )
+  {
+    off_t want = len;
+    if( !s->readable )
+    {
+      s->waiting = 1;
+      setup_callbacks( src );
+      return SOURCE_FD_WAIT;
+    }
+    if( s->pipe_fds[0] < 0 && !open_pipe( s ) )
+      return to_copy_path( s );
+    if( s->len > 0 && want > s->len )
+      want = s->len;
+    /* Until the destination has accepted a splice, keep what is in
+     * the pipe small enough to be moved back to the read buffer.
+     */
+    if( !s->dest_ok && want > CHUNK )
+      want = CHUNK;
+
+    THREADS_ALLOW();
+    do {
+      n = splice( s->fd, NULL, s->pipe_fds[1], NULL, want,
+		  SPLICE_F_MOVE|SPLICE_F_NONBLOCK );
+    } while( (n < 0) && (errno == EINTR) );
+    e = errno;
+    THREADS_DISALLOW();
+
+    s->readable = 0;
+    if( !n )
+    {
+      s->s.eof = 1;
+      return 0;
+    }
+    if( n < 0 )
+    {
+      switch( e )
+      {
+	case EAGAIN:
+#if defined(EWOULDBLOCK) && (EWOULDBLOCK != EAGAIN)
+	case EWOULDBLOCK:
+#endif
+	  s->waiting = 1;
+	  setup_callbacks( src );
+	  return SOURCE_FD_WAIT;
+	case EINVAL:
+	case ENOSYS:
+	  return to_copy_path( s );
+      }
+      close_pipe( s );
+      return SOURCE_FD_READ_ERROR;
+    }
+    s->piped = n;
+    if( s->len > 0 )
+      s->len -= n;
+  }
+
+  THREADS_ALLOW();
+  do {
+    n = splice( s->pipe_fds[0], NULL, to, NULL, MINIMUM(s->piped, len),
+		SPLICE_F_MOVE|SPLICE_F_NONBLOCK );
+  } while( (n < 0) && (errno == EINTR) );
+  e = errno;
+  THREADS_DISALLOW();
+
+  if( n < 0 )
+  {
+    switch( e )
+    {
+      case EAGAIN:
+#if defined(EWOULDBLOCK) && (EWOULDBLOCK != EAGAIN)
+      case EWOULDBLOCK:
+#endif
+	return 0;
+      case EINVAL:
+      case ENOSYS:
+	if( s->dest_ok )
+	  break;
+	/* The destination does not support splice. Move the data back
+	 * to user space and continue with get_data.
+	 */
+	n = fd_read( s->pipe_fds[0], s->_read_buffer, s->piped );
+	if( n != s->piped )
+	{
+	  close_pipe( s );
+	  return SOURCE_FD_READ_ERROR;
+	}
+	s->available = s->piped;
+	s->piped = 0;
+	return to_copy_path( s );
+    }
+    return -1;
+  }
+
+  s->dest_ok = 1;
+  s->piped -= n;
+  if( !s->piped && !s->len )
+    s->s.eof = 1;
+  return n;
+}
+#endif
+
 static void free_source( struct source *src )
 {
   remove_callbacks( src );
+#ifdef SHUFFLER_SPLICE
+  close_pipe( (struct fd_source *)src );
+#endif
   free_object(((struct fd_source *)src)->obj);
 }
 
@@ -95,6 +271,18 @@ static void read_callback( int UNUSED(fd), struct fd_source *s )
   int l;
   remove_callbacks( (struct source *)s );
 
+#ifdef SHUFFLER_SPLICE
+  if( s->s.send_to_fd )
+  {
+    /* Let send_to_fd move the data. */
+    s->waiting = 0;
+    s->readable = 1;
+    if( s->when_data_cb )
+      s->when_data_cb( s->when_data_cb_arg );
+    return;
+  }
+#endif
+
   if( s->s.eof )
   {
     if( s->when_data_cb )
@@ -183,6 +371,13 @@ struct source *source_stream_make( struct svalue *s,
   res->s.remove_callbacks = remove_callbacks;
   res->obj = s->u.object;
   add_ref(res->obj);
+
+#ifdef SHUFFLER_SPLICE
+  res->pipe_fds[0] = res->pipe_fds[1] = -1;
+  /* Data to skip has to pass through user space anyway. */
+  if( !start )
+    res->s.send_to_fd = send_to_fd;
+#endif
   return (struct source *)res;
 }
 
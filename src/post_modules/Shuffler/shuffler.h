@@ -30,8 +30,32 @@ struct source
    * get_data with a 'len' value of -2.
    */
   void (*set_callback)( struct source *s, void (*cb)( void *a ), void *a );
+
+  /* Optional. Used by sources that are backed by a file descriptor to
+   * move up to 'len' bytes directly to the destination file descriptor
+   * 'to' inside the kernel (sendfile(2) or splice(2)), without copying
+   * the data through a struct data buffer.
+   *
+   * Returns the number of bytes written to 'to', 0 if 'to' would
+   * block, -1 on write errors, or one of the SOURCE_FD_* codes below.
+   */
+  ptrdiff_t (*send_to_fd)( struct source *s, int to, off_t len );
 };
 
+/* The source has no data available right now. Works like a 'len' of
+ * -2 from get_data, ie set_callback will be used.
+ */
+#define SOURCE_FD_WAIT		-2
+/* The kernel path can not be used right now, call get_data instead. */
+#define SOURCE_FD_COPY		-3
+/* Reading from the source failed. */
+#define SOURCE_FD_READ_ERROR	-4
+
+/* How the data of a Shuffle was sent. */
+#define TRANSFER_NONE	0
+#define TRANSFER_COPY	1
+#define TRANSFER_KERNEL	2
+
 
 typedef enum
 {
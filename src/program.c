@@ -3465,6 +3465,13 @@ static void exit_program_struct(struct program *p)
   if(id_to_program_cache[p->id & (ID_TO_PROGRAM_CACHE_SIZE-1)]==p)
     id_to_program_cache[p->id & (ID_TO_PROGRAM_CACHE_SIZE-1)]=0;
 
+  if(p->inline_caches)
+  {
+    inline_cache_stats.sites -= p->num_strings;
+    free(p->inline_caches);
+    p->inline_caches = NULL;
+  }
+
   if(p->strings)
     for(e=0; e<p->num_strings; e++)
       if(p->strings[e])
@@ -7397,6 +7404,60 @@ int find_shared_string_identifier(struct pike_string *name,
   return low_find_shared_string_identifier(name,prog);
 }
 
+/* Inline caches for F_ARROW, F_LOCAL_ARROW and the F_CALL_OTHER
+ * opcodes.
+ *
+ * A call site is identified by the calling program and the index of
+ * the identifier name in its string table. Each call site remembers
+ * the identifiers found in the last INLINE_CACHE_WAYS programs it has
+ * indexed. The programs are identified by their ids, which are never
+ * reused, so freeing a program needs no invalidation. Unlike the
+ * global cache above, call sites never evict each other.
+ */
+
+PMOD_EXPORT struct inline_cache_stats inline_cache_stats;
+
+PMOD_EXPORT int low_find_cached_identifier(struct program *caller,
+					   int string_no,
+					   struct program *prog)
+{
+  struct pike_string *name = caller->strings[string_no];
+  struct inline_cache *ic;
+  int i, fun;
+
+  if (!(caller->flags & PROGRAM_FIXED) || !(prog->flags & PROGRAM_FIXED))
+    return find_shared_string_identifier(name, prog);
+
+  if (!(ic = caller->inline_caches)) {
+    ic = caller->inline_caches =
+      xcalloc(caller->num_strings, sizeof(struct inline_cache));
+    inline_cache_stats.sites += caller->num_strings;
+  }
+  ic += string_no;
+
+  for (i = 1; i < INLINE_CACHE_WAYS; i++) {
+    if (ic->prog_id[i] == prog->id) {
+      inline_cache_stats.poly_hits++;
+      /* Move the entry to the front. */
+      fun = ic->fun[i];
+      memmove(ic->prog_id + 1, ic->prog_id, i * sizeof(INT32));
+      memmove(ic->fun + 1, ic->fun, i * sizeof(INT32));
+      ic->prog_id[0] = prog->id;
+      ic->fun[0] = fun;
+      return fun;
+    }
+  }
+
+  inline_cache_stats.misses++;
+  fun = find_shared_string_identifier(name, prog);
+  memmove(ic->prog_id + 1, ic->prog_id,
+	  (INLINE_CACHE_WAYS - 1) * sizeof(INT32));
+  memmove(ic->fun + 1, ic->fun, (INLINE_CACHE_WAYS - 1) * sizeof(INT32));
+  ic->prog_id[0] = prog->id;
+  ic->fun[0] = fun;
+  return fun;
+}
+
 PMOD_EXPORT int find_identifier(const char *name,const struct program *prog)
 {
   struct pike_string *n;
@@ -622,6 +622,24 @@ struct identifier_lookup_cache
   INT32 identifier_id;
 };
 
+/* Inline cache for the identifier lookups of one call site, see
+ * find_cached_identifier(). */
+#define INLINE_CACHE_WAYS	4
+
+struct inline_cache
+{
+  INT32 prog_id[INLINE_CACHE_WAYS];	/* Most recently used first. */
+  INT32 fun[INLINE_CACHE_WAYS];
+};
+
+struct inline_cache_stats
+{
+  UINT64 mono_hits;	/* Hits on the most recently used entry. */
+  UINT64 poly_hits;	/* Hits on the other entries. */
+  UINT64 misses;
+  UINT64 sites;		/* Allocated call site caches. */
+};
+
 struct program
 {
   GC_MARKER_MEMBERS;
@@ -656,6 +674,9 @@ struct program
 
   size_t total_size;
 
+  /* Inline caches, one per entry in strings, or NULL. */
+  struct inline_cache *inline_caches;
+
 #define FOO(NUMTYPE,TYPE,ARGTYPE,NAME) TYPE * NAME ;
 #include "program_areas.h"
 
@@ -719,6 +740,28 @@ static inline struct identifier *ID_FROM_INT(const struct program *p, unsigned I
 
 #define QUICK_FIND_LFUN(P,N) (dmalloc_touch(struct program *,(P))->lfuns[N])
 
+PMOD_EXPORT extern struct inline_cache_stats inline_cache_stats;
+PMOD_EXPORT int low_find_cached_identifier(struct program *caller,
+					   int string_no,
+					   struct program *prog);
+
+/* Look up the identifier named caller->strings[string_no] in prog,
+ * using the inline cache of the call site. */
+static inline int find_cached_identifier(struct program *caller,
+					 int string_no,
+					 struct program *prog)
+{
+  struct inline_cache *ic = caller->inline_caches;
+  if (LIKELY(ic != NULL)) {
+    ic += string_no;
+    if (LIKELY(ic->prog_id[0] == prog->id)) {
+      inline_cache_stats.mono_hits++;
+      return ic->fun[0];
+    }
+  }
+  return low_find_cached_identifier(caller, string_no, prog);
+}
+
 #ifdef DO_PIKE_CLEANUP
 PMOD_EXPORT extern int gc_external_refs_zapped;
 PMOD_EXPORT void gc_check_zapped (void *a, TYPE_T type, const char *file, INT_TYPE line);
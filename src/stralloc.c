@@ -48,6 +48,17 @@ static size_t hashkey = 0;
 static unsigned INT32 htable_size=0;
 static struct pike_string **base_table=0;
 static unsigned INT32 num_strings=0;
+
+/* The table is grown incrementally. When it's doubled, the old table
+ * is kept in old_table, and REHASH_STEP of its buckets are moved to
+ * the new table every time a string is linked. Bucket h in the old
+ * table has been moved iff h < rehash_pos.
+ */
+#define REHASH_STEP 8
+static struct pike_string **old_table=0;
+static unsigned INT32 old_htable_mask=0;
+static unsigned INT32 rehash_pos=0;
+
 PMOD_EXPORT struct pike_string *empty_pike_string = 0;
 
 /*** Main string hash function ***/
@@ -56,6 +67,27 @@ PMOD_EXPORT struct pike_string *empty_pike_string = 0;
 #define low_do_hash(STR,LEN,SHIFT) low_hashmem( (STR), (LEN)<<(SHIFT), hash_prefix_len<<(SHIFT), hashkey )
 #define do_hash(STR) low_do_hash(STR->str,STR->len,STR->size_shift)
 
+/* Returns the hash chain that a string with the hash value hval
+ * belongs to.
+ */
+static inline struct pike_string **string_bucket(size_t hval)
+{
+  if (old_table) {
+    size_t h = hval & old_htable_mask;
+    if (h >= rehash_pos) return old_table + h;
+  }
+  return base_table + HMODULO(hval);
+}
+
+static void stralloc_rehash_step(unsigned INT32 buckets);
+
+/* Move all remaining strings from the old table. Used before
+ * operations that scan the whole table.
+ */
+#define stralloc_finish_rehash() do {			\
+    if (old_table) stralloc_rehash_step(old_htable_mask + 1);	\
+  } while(0)
+
 /* Returns true if str could contain n. */
 PMOD_EXPORT int string_range_contains( struct pike_string *str, int n )
 {
@@ -344,6 +376,7 @@ static void locate_problem(int (*isproblem)(const struct pike_string *))
   DM(struct memhdr *yes=alloc_memhdr());
   DM(struct memhdr *no=alloc_memhdr());
 
+  stralloc_finish_rehash();
   for(e=0;e<htable_size;e++)
   {
     for(s=base_table[e];s;s=s->next)
@@ -399,9 +432,7 @@ static struct pike_string *internal_findstring(const char *s,
   unsigned int depth=0;
   unsigned int prefix_depth=0;
 
-  size_t h;
-  h=HMODULO(hval);
-  for(curr = base_table[h]; curr; curr = curr->next)
+  for(curr = *string_bucket(hval); curr; curr = curr->next)
   {
 #ifdef PIKE_DEBUG
     if(curr->refs<1)
@@ -484,25 +515,40 @@ static void rehash_string_backwards(struct pike_string *s)
   } while ((s = next));
 }
 
-static void stralloc_rehash(void)
+static void stralloc_rehash_step(unsigned INT32 buckets)
 {
-  int h,old;
-  struct pike_string **old_base;
+  while (buckets-- && (rehash_pos <= old_htable_mask)) {
+    rehash_string_backwards(old_table[rehash_pos]);
+    old_table[rehash_pos++] = NULL;
+  }
 
-  old=htable_size;
-  old_base=base_table;
+  if (rehash_pos > old_htable_mask) {
+    free(old_table);
+    old_table = NULL;
+    old_htable_mask = 0;
+    rehash_pos = 0;
+  }
+}
 
-  SET_HSIZE(htable_size<<1);
+/* Double the size of the table. The strings are moved to the new
+ * table by stralloc_rehash_step().
+ */
+static void stralloc_rehash(void)
+{
+  struct pike_string **new_table;
 
-  base_table=xcalloc(sizeof(struct pike_string *), htable_size);
+  stralloc_finish_rehash();
 
-  need_more_hash_prefix_depth = 0;
+  new_table=xcalloc(sizeof(struct pike_string *), htable_size<<1);
+
+  old_table=base_table;
+  old_htable_mask=htable_mask;
+  rehash_pos=0;
 
-  for(h=0;h<old;h++)
-    rehash_string_backwards(old_base[h]);
+  base_table=new_table;
+  SET_HSIZE(htable_size<<1);
 
-  if(old_base)
-    free(old_base);
+  need_more_hash_prefix_depth = 0;
 }
 
 /* Allocation of strings */
@@ -558,6 +604,7 @@ PMOD_EXPORT struct pike_string *debug_begin_shared_string(size_t len)
 
 static void link_pike_string(struct pike_string *s, size_t hval)
 {
+  struct pike_string **bucket;
   size_t h;
 #ifdef PIKE_DEBUG
   if (!(s->flags & STRING_NOT_SHARED)) {
@@ -569,14 +616,16 @@ static void link_pike_string(struct pike_string *s, size_t hval)
     Pike_fatal ("Got undefined contents in pike string %p.\n", s);
 #endif
 
-  h=HMODULO(hval);
-  s->next = base_table[h];
-  base_table[h] = s;
+  bucket = string_bucket(hval);
+  s->next = *bucket;
+  *bucket = s;
   s->hval=hval;
   s->flags &= ~(STRING_NOT_HASHED|STRING_NOT_SHARED);
   num_strings++;
 
-  if(num_strings > htable_size) {
+  if (old_table) {
+    stralloc_rehash_step(REHASH_STEP);
+  } else if(num_strings > htable_size) {
     stralloc_rehash();
   }
 
@@ -618,6 +667,7 @@ static void link_pike_string(struct pike_string *s, size_t hval)
      */
     need_more_hash_prefix_depth=0;
 
+    stralloc_finish_rehash();
     for(h=0;h<htable_size;h++)
     {
       struct pike_string *tmp=base_table[h];
@@ -1015,8 +1065,8 @@ PMOD_EXPORT struct pike_string *debug_make_shared_string2(const p_wchar2 *str)
 
 void unlink_pike_string(struct pike_string *s)
 {
-  size_t h=HMODULO(s->hval);
-  struct pike_string *tmp=base_table[h], *p=NULL;
+  struct pike_string **bucket = string_bucket(s->hval);
+  struct pike_string *tmp=*bucket, *p=NULL;
 
   while( tmp )
   {
@@ -1025,7 +1075,7 @@ void unlink_pike_string(struct pike_string *s)
       if( p )
         p->next = s->next;
       else
-        base_table[h] = s->next;
+        *bucket = s->next;
       break;
     }
     p = tmp;
@@ -1112,6 +1162,7 @@ struct pike_string *add_string_status(int verbose)
     long overhead_bytes[8] = {0,0,0,0,0,0,0,0};
     unsigned INT32 e;
     struct pike_string *p;
+    stralloc_finish_rehash();
     for(e=0;e<htable_size;e++)
     {
       for(p=base_table[e];p;p=p->next)
@@ -1265,6 +1316,7 @@ PMOD_EXPORT void verify_shared_strings_tables(void)
 
   last_stralloc_verify=current_do_debug_cycle;
 
+  stralloc_finish_rehash();
   for(e=0;e<htable_size;e++)
   {
     h=0;
@@ -1325,12 +1377,10 @@ PMOD_EXPORT void verify_shared_strings_tables(void)
  */
 const struct pike_string *debug_findstring(const struct pike_string *s)
 {
-  size_t h;
   struct pike_string *p;
 
   if(!base_table) return NULL;
-  h = HMODULO(s->hval);
-  for(p=base_table[h];p;p=p->next)
+  for(p=*string_bucket(s->hval);p;p=p->next)
   {
     if(p==s)
     {
@@ -1344,6 +1394,7 @@ int safe_debug_findstring(const struct pike_string *foo)
 {
   unsigned INT32 e;
   if(!base_table) return 0;
+  stralloc_finish_rehash();
   for(e=0;e<htable_size;e++)
   {
     struct pike_string *p;
@@ -1400,6 +1451,7 @@ void dump_stralloc_strings(void)
 {
   unsigned INT32 e;
   struct pike_string *p;
+  stralloc_finish_rehash();
   for(e=0;e<htable_size;e++)
   {
     for(p=base_table[e];p;p=p->next) {
@@ -2132,6 +2184,7 @@ void cleanup_shared_string_table(void)
   }
 #endif
 
+  stralloc_finish_rehash();
   for(e=0;e<htable_size;e++)
   {
     for(s=base_table[e];s;s=next)
@@ -2154,6 +2207,7 @@ void count_string_types() {
   unsigned INT32 e;
   size_t num_static = 0, num_short = 0, num_substring = 0, num_malloc = 0;
 
+  stralloc_finish_rehash();
   for (e = 0; e < htable_size; e++) {
       struct pike_string * s;
 
@@ -2210,6 +2264,7 @@ void count_memory_in_strings(size_t *num, size_t *_size)
   size_t size = 0;
   *num = num_strings;
 
+  stralloc_finish_rehash();
   size+=htable_size * sizeof(struct pike_string *);
 
   for (e = 0; e < htable_size; e++) {
@@ -2247,6 +2302,7 @@ unsigned gc_touch_all_strings(void)
   unsigned INT32 e;
   unsigned n = 0;
   if (!base_table) return 0;
+  stralloc_finish_rehash();
   for(e=0;e<htable_size;e++)
   {
     struct pike_string *p;
@@ -2259,6 +2315,7 @@ void gc_mark_all_strings(void)
 {
   unsigned INT32 e;
   if(!base_table) return;
+  stralloc_finish_rehash();
   for(e=0;e<htable_size;e++)
   {
     struct pike_string *p;
@@ -2269,7 +2326,9 @@ void gc_mark_all_strings(void)
 
 PMOD_EXPORT struct pike_string *next_pike_string (const struct pike_string *s)
 {
-  struct pike_string *next = s->next;
+  struct pike_string *next;
+  stralloc_finish_rehash();
+  next = s->next;
   if (!next) {
     size_t h = s->hval;
     do {